@@ -4,6 +4,7 @@
 #include <QFontDatabase>
 #include <QMimeData>
 #include <QQuickItem>
+#include <QQuickWindow>
 #include <QQuickStyle>
 #include <QResource>
 #include <QStandardPaths>
@@ -13,6 +14,7 @@
 #include <QLocalSocket>
 #include <QLocalServer>
 
+#include "core/startupprofiler.h"
 #include "logger.h"
 #include "ui/models/installedAppsModel.h"
 #include "version.h"
@@ -50,7 +52,10 @@ AmneziaApplication::AmneziaApplication(int &argc, char *argv[]) : AMNEZIA_BASE_C
     QFile::setPermissions(configLoc2, QFileDevice::ReadOwner | QFileDevice::WriteOwner);
 #endif
 
-    m_settings = std::shared_ptr<Settings>(new Settings);
+    {
+        StartupProfiler::Scope phase("settings load");
+        m_settings = std::shared_ptr<Settings>(new Settings);
+    }
     m_nam = new QNetworkAccessManager(this);
 }
 
@@ -84,9 +89,18 @@ void AmneziaApplication::init()
     m_vpnConnection->moveToThread(&m_vpnConnectionThread);
     m_vpnConnectionThread.start();
 
-    initModels();
-    loadTranslator();
-    initControllers();
+    {
+        StartupProfiler::Scope phase("model construction");
+        initModels();
+    }
+    {
+        StartupProfiler::Scope phase("translator");
+        loadTranslator();
+    }
+    {
+        StartupProfiler::Scope phase("controller construction");
+        initControllers();
+    }
 
 #ifdef Q_OS_ANDROID
     if (!AndroidController::initLogging()) {
@@ -155,9 +169,28 @@ void AmneziaApplication::init()
 #endif
 
     m_engine->addImportPath("qrc:/ui/qml/Modules/");
-    m_engine->load(url);
+    {
+        StartupProfiler::Scope phase("QML load");
+        m_engine->load(url);
+    }
     m_systemController->setQmlRoot(m_engine->rootObjects().value(0));
 
+    if (StartupProfiler::instance()->isEnabled()) {
+        // The start is over once the first frame is on the screen or, if the window
+        // stays hidden, once the event loop gets idle
+        if (auto window = qobject_cast<QQuickWindow *>(m_engine->rootObjects().value(0))) {
+            connect(
+                    window, &QQuickWindow::frameSwapped, this,
+                    []() {
+                        StartupProfiler::instance()->mark("first frame");
+                        StartupProfiler::instance()->finish();
+                    },
+                    static_cast<Qt::ConnectionType>(Qt::QueuedConnection | Qt::SingleShotConnection));
+        }
+        QTimer::singleShot(0, this, []() { StartupProfiler::instance()->mark("event loop"); });
+        connect(this, &QCoreApplication::aboutToQuit, this, []() { StartupProfiler::instance()->finish(); });
+    }
+
     bool enabled = m_settings->isSaveLogs();
 #ifndef Q_OS_ANDROID
     if (enabled) {
@@ -2,6 +2,7 @@
 
 #include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QEventLoop>
 #include <QFile>
 #include <QFileInfo>
@@ -9,8 +10,10 @@
 #include <QJsonObject>
 #include <QLoggingCategory>
 #include <QPointer>
+#include <QRandomGenerator>
 #include <QTemporaryFile>
 #include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QtConcurrent>
 
@@ -19,6 +22,7 @@
 #include <iostream>
 #include <sys/stat.h>
 
+#include <array>
 #include <chrono>
 #include <thread>
 
@@ -34,6 +38,39 @@
 namespace
 {
     Logger logger("ServerController");
+
+    constexpr char uploadDoneMarker[] = "AMNEZIA_UPLOAD_DONE";
+
+    QString shellQuote(const QString &value)
+    {
+        return "'" + QString(value).replace("'", "'\\''") + "'";
+    }
+
+    // Checksum computed by the POSIX cksum utility, available in every image
+    quint32 posixCksum(const QByteArray &data)
+    {
+        static const std::array<quint32, 256> table = []() {
+            std::array<quint32, 256> t {};
+            for (quint32 i = 0; i < 256; ++i) {
+                quint32 c = i << 24;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 0x80000000u) ? (c << 1) ^ 0x04C11DB7u : c << 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        quint32 crc = 0;
+        auto update = [&crc](quint8 byte) { crc = (crc << 8) ^ table[((crc >> 24) ^ byte) & 0xFF]; };
+        for (char byte : data) {
+            update(static_cast<quint8>(byte));
+        }
+        for (quint64 length = data.size(); length != 0; length >>= 8) {
+            update(static_cast<quint8>(length & 0xFF));
+        }
+        return ~crc;
+    }
 }
 
 ServerController::ServerController(std::shared_ptr<Settings> settings, QObject *parent) : m_settings(settings)
@@ -47,7 +84,8 @@ ServerController::~ServerController()
 
 ErrorCode ServerController::runScript(const ServerCredentials &credentials, QString script,
                                       const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut,
-                                      const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr)
+                                      const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr,
+                                      QList<int> *stepExitCodes)
 {
 
     auto error = m_sshClient.connectToHost(credentials);
@@ -59,6 +97,7 @@ ErrorCode ServerController::runScript(const ServerCredentials &credentials, QStr
 
     qDebug() << "ServerController::Run script";
 
+    QStringList steps;
     QString totalLine;
     const QStringList &lines = script.split("\n", Qt::SkipEmptyParts);
     for (int i = 0; i < lines.count(); i++) {
@@ -83,11 +122,57 @@ ErrorCode ServerController::runScript(const ServerCredentials &credentials, QStr
         }
 
         qDebug().noquote() << lineToExec;
+        steps.append(lineToExec);
+    }
 
-        error = m_sshClient.executeCommand(lineToExec, cbReadStdOut, cbReadStdErr);
-        if (error != ErrorCode::NoError) {
-            return error;
+    if (steps.isEmpty()) {
+        return ErrorCode::NoError;
+    }
+
+    // Every step reports its exit code on stdout after a random marker, the marker
+    // is cut out of the output lines before they reach the callbacks
+    const QString marker = "AMNEZIA_STEP_" + Utils::getRandomString(16);
+    QString command;
+    for (int i = 0; i < steps.size(); i++) {
+        command += "(\n" + steps.at(i) + "\n)\nprintf '" + marker + " " + QString::number(i) + " %d\\n' $?\n";
+    }
+
+    QList<int> exitCodes(steps.size(), -1);
+    auto cbStdOut = [&](const QString &line, libssh::Client &client) {
+        // Output of a step that does not end with a newline is followed by the marker on the same line
+        const qsizetype markerPos = line.indexOf(marker);
+        if (markerPos >= 0) {
+            const QStringList status = line.mid(markerPos + marker.size()).split(' ', Qt::SkipEmptyParts);
+            if (status.size() == 2) {
+                const int step = status.at(0).toInt();
+                if (step >= 0 && step < exitCodes.size()) {
+                    exitCodes[step] = status.at(1).toInt();
+                }
+            }
+            if (markerPos == 0) {
+                return ErrorCode::NoError;
+            }
+        }
+
+        if (!cbReadStdOut) {
+            return ErrorCode::NoError;
         }
+        return cbReadStdOut(markerPos >= 0 ? line.left(markerPos) : line, client);
+    };
+
+    error = m_sshClient.executeCommand(command, cbStdOut, cbReadStdErr);
+
+    for (int i = 0; i < exitCodes.size(); i++) {
+        if (exitCodes.at(i) != 0) {
+            qDebug().noquote() << QString("ServerController::runScript step %1 exited with %2").arg(i).arg(exitCodes.at(i));
+        }
+    }
+    if (stepExitCodes) {
+        *stepExitCodes = exitCodes;
+    }
+
+    if (error != ErrorCode::NoError) {
+        return error;
     }
 
     qDebug().noquote() << "ServerController::runScript finished\n";
@@ -117,76 +202,133 @@ ErrorCode ServerController::runContainerScript(const ServerCredentials &credenti
 ErrorCode ServerController::uploadTextFileToContainer(DockerContainer container, const ServerCredentials &credentials, const QString &file,
                                                       const QString &path, libssh::ScpOverwriteMode overwriteMode)
 {
-    ErrorCode e = ErrorCode::NoError;
-    QString tmpFileName = QString("/tmp/%1.tmp").arg(Utils::getRandomString(16));
-    e = uploadFileToHost(credentials, file.toUtf8(), tmpFileName);
-    if (e)
-        return e;
-
-    QString stdOut;
-    auto cbReadStd = [&](const QString &data, libssh::Client &) {
-        stdOut += data + "\n";
-        return ErrorCode::NoError;
-    };
-
-    // mkdir
-    QString mkdir = QString("sudo docker exec -i $CONTAINER_NAME mkdir -p  \"$(dirname %1)\"").arg(path);
-
-    e = runScript(credentials, replaceVars(mkdir, genVarsForScript(credentials, container)));
-    if (e)
-        return e;
-
+    QString redirect;
     if (overwriteMode == libssh::ScpOverwriteMode::ScpOverwriteExisting) {
-        e = runScript(credentials,
-                      replaceVars(QString("sudo docker cp %1 $CONTAINER_NAME:/%2").arg(tmpFileName).arg(path),
-                                  genVarsForScript(credentials, container)),
-                      cbReadStd, cbReadStd);
-
-        if (e)
-            return e;
+        redirect = ">";
     } else if (overwriteMode == libssh::ScpOverwriteMode::ScpAppendToExisting) {
-        e = runScript(credentials,
-                      replaceVars(QString("sudo docker cp %1 $CONTAINER_NAME:/%2").arg(tmpFileName).arg(tmpFileName),
-                                  genVarsForScript(credentials, container)),
-                      cbReadStd, cbReadStd);
+        redirect = ">>";
+    } else {
+        return ErrorCode::NotImplementedError;
+    }
 
-        if (e)
-            return e;
+    auto error = m_sshClient.connectToHost(credentials);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
 
-        e = runScript(credentials,
-                      replaceVars(QString("sudo docker exec -i $CONTAINER_NAME sh -c \"cat %1 >> %2\"").arg(tmpFileName).arg(path),
-                                  genVarsForScript(credentials, container)),
-                      cbReadStd, cbReadStd);
+    // The content goes to the container over stdin of a single exec. It is written to a
+    // copy of the file next to it, which keeps its mode, and renamed over the file, so
+    // readers never see a partially written file.
+    const QString writer = QString("f=%1; t=\"$f.$$.tmp\"; mkdir -p \"$(dirname \"$f\")\" "
+                                   "&& if [ -f \"$f\" ]; then cp -p \"$f\" \"$t\"; fi "
+                                   "&& cat %2 \"$t\" && mv -f \"$t\" \"$f\" && echo %3 || { rm -f \"$t\"; exit 1; }")
+                                   .arg(shellQuote(path), redirect, uploadDoneMarker);
+    const QString script =
+            QString("sudo docker exec -i %1 sh -c %2").arg(ContainerProps::containerToString(container), shellQuote(writer));
+
+    QByteArray stdOut;
+    QByteArray stdErr;
+    auto cbReadStdOut = [&](const QByteArray &chunk, libssh::Client &) {
+        stdOut.append(chunk);
+        return ErrorCode::NoError;
+    };
+    auto cbReadStdErr = [&](const QByteArray &chunk, libssh::Client &) {
+        stdErr.append(chunk);
+        return ErrorCode::NoError;
+    };
 
-        if (e)
-            return e;
-    } else
-        return ErrorCode::NotImplementedError;
+    error = m_sshClient.executeCommandWithInput(script, file.toUtf8(), cbReadStdOut, cbReadStdErr);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
 
-    if (stdOut.contains("Error") && stdOut.contains("No such container")) {
+    if (stdErr.contains("No such container")) {
         return ErrorCode::ServerContainerMissingError;
     }
-
-    runScript(credentials, replaceVars(QString("sudo shred -u %1").arg(tmpFileName), genVarsForScript(credentials, container)));
-    return e;
+    if (!stdOut.contains(uploadDoneMarker)) {
+        logger.error() << "Failed to write" << path << ":" << QString::fromUtf8(stdErr).trimmed();
+        return ErrorCode::ServerFileWriteError;
+    }
+    return ErrorCode::NoError;
 }
 
 QByteArray ServerController::getTextFileFromContainer(DockerContainer container, const ServerCredentials &credentials, const QString &path,
                                                       ErrorCode &errorCode)
 {
+    QByteArray data;
+    errorCode = downloadFileFromContainer(container, credentials, path, data);
+    return data;
+}
 
-    errorCode = ErrorCode::NoError;
+ErrorCode ServerController::downloadFileFromContainer(DockerContainer container, const ServerCredentials &credentials, const QString &path,
+                                                      QByteArray &data, qint64 maxSize)
+{
+    data.clear();
 
-    QString script = QString("sudo docker exec -i %1 sh -c \"xxd -p \'%2\'\"").arg(ContainerProps::containerToString(container)).arg(path);
+    auto error = m_sshClient.connectToHost(credentials);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
 
-    QString stdOut;
-    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
-        stdOut += data;
-        return ErrorCode::NoError;
-    };
+    // The output is a "<cksum> <size>" header line followed by the file itself
+    const QString reader = QString("f=%1; [ -r \"$f\" ] || exit 2; s=$(wc -c < \"$f\"); "
+                                   "if [ \"$s\" -gt %2 ]; then echo \"0 $s\"; exit 3; fi; "
+                                   "set -- $(cksum < \"$f\"); echo \"$1 $2\"; cat \"$f\"")
+                                   .arg(shellQuote(path))
+                                   .arg(maxSize);
+    const QString script =
+            QString("sudo docker exec -i %1 sh -c %2").arg(ContainerProps::containerToString(container), shellQuote(reader));
+
+    // The file may change between cksum and cat, such a download is repeated once
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        QByteArray output;
+        qsizetype headerEnd = -1;
+        qint64 size = -1;
+        quint32 checksum = 0;
+
+        auto cbReadStdOut = [&](const QByteArray &chunk, libssh::Client &) {
+            output.append(chunk);
+            if (headerEnd < 0) {
+                headerEnd = output.indexOf('\n');
+                if (headerEnd < 0) {
+                    return output.size() > 64 ? ErrorCode::ServerFileChecksumError : ErrorCode::NoError;
+                }
+                const QList<QByteArray> header = output.left(headerEnd).split(' ');
+                checksum = header.value(0).toUInt();
+                size = header.value(1).toLongLong();
+                if (size > maxSize) {
+                    return ErrorCode::ServerFileTooLargeError;
+                }
+                output.reserve(headerEnd + 1 + size);
+            }
+            if (output.size() - headerEnd - 1 > size) {
+                return ErrorCode::ServerFileChecksumError;
+            }
+            return ErrorCode::NoError;
+        };
 
-    errorCode = runScript(credentials, script, cbReadStdOut);
-    return QByteArray::fromHex(stdOut.toUtf8());
+        error = m_sshClient.executeCommandBytes(script, cbReadStdOut, nullptr);
+        if (error == ErrorCode::ServerFileTooLargeError) {
+            logger.error() << "File" << path << "is too large to download:" << size << "bytes";
+            return error;
+        }
+        if (error != ErrorCode::NoError && error != ErrorCode::ServerFileChecksumError) {
+            return error;
+        }
+        if (error == ErrorCode::NoError && headerEnd < 0) {
+            // No such file or container, same as an empty file for the callers
+            return ErrorCode::NoError;
+        }
+
+        const QByteArray content = output.mid(headerEnd + 1);
+        if (error == ErrorCode::NoError && content.size() == size && posixCksum(content) == checksum) {
+            data = content;
+            return ErrorCode::NoError;
+        }
+        logger.warning() << "Checksum mismatch for" << path << ", attempt" << attempt + 1;
+    }
+
+    return ErrorCode::ServerFileChecksumError;
 }
 
 ErrorCode ServerController::uploadFileToHost(const ServerCredentials &credentials, const QByteArray &data, const QString &remotePath,
@@ -236,7 +378,7 @@ ErrorCode ServerController::removeAllContainers(const ServerCredentials &credent
 ErrorCode ServerController::removeContainer(const ServerCredentials &credentials, DockerContainer container)
 {
     return runScript(credentials,
-                     replaceVars(amnezia::scriptData(SharedScriptType::remove_container), genVarsForScript(credentials, container)));
+                     replaceVars(amnezia::scriptTemplate(SharedScriptType::remove_container), genVarsForScript(credentials, container)));
 }
 
 ErrorCode ServerController::setupContainer(const ServerCredentials &credentials, DockerContainer container, QJsonObject &config, bool isUpdate)
@@ -399,7 +541,7 @@ ErrorCode ServerController::installDockerWorker(const ServerCredentials &credent
     };
 
     ErrorCode error =
-            runScript(credentials, replaceVars(amnezia::scriptData(SharedScriptType::install_docker), genVarsForScript(credentials)),
+            runScript(credentials, replaceVars(amnezia::scriptTemplate(SharedScriptType::install_docker), genVarsForScript(credentials)),
                       cbReadStdOut, cbReadStdErr);
 
     qDebug().noquote() << "ServerController::installDockerWorker" << stdOut;
@@ -414,7 +556,7 @@ ErrorCode ServerController::installDockerWorker(const ServerCredentials &credent
 ErrorCode ServerController::prepareHostWorker(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &config)
 {
     // create folder on host
-    return runScript(credentials, replaceVars(amnezia::scriptData(SharedScriptType::prepare_host), genVarsForScript(credentials, container)));
+    return runScript(credentials, replaceVars(amnezia::scriptTemplate(SharedScriptType::prepare_host), genVarsForScript(credentials, container)));
 }
 
 ErrorCode ServerController::buildContainerWorker(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &config)
@@ -438,7 +580,7 @@ ErrorCode ServerController::buildContainerWorker(const ServerCredentials &creden
 
     errorCode =
             runScript(credentials,
-                      replaceVars(amnezia::scriptData(SharedScriptType::build_container), genVarsForScript(credentials, container, config)),
+                      replaceVars(amnezia::scriptTemplate(SharedScriptType::build_container), genVarsForScript(credentials, container, config)),
                       cbReadStdOut);
     if (errorCode)
         return errorCode;
@@ -455,7 +597,7 @@ ErrorCode ServerController::runContainerWorker(const ServerCredentials &credenti
     };
 
     ErrorCode e = runScript(credentials,
-                            replaceVars(amnezia::scriptData(ProtocolScriptType::run_container, container),
+                            replaceVars(amnezia::scriptTemplate(ProtocolScriptType::run_container, container),
                                         genVarsForScript(credentials, container, config)),
                             cbReadStdOut);
 
@@ -482,7 +624,7 @@ ErrorCode ServerController::configureContainerWorker(const ServerCredentials &cr
     };
 
     ErrorCode e = runContainerScript(credentials, container,
-                                     replaceVars(amnezia::scriptData(ProtocolScriptType::configure_container, container),
+                                     replaceVars(amnezia::scriptTemplate(ProtocolScriptType::configure_container, container),
                                                  genVarsForScript(credentials, container, config)),
                                      cbReadStdOut, cbReadStdErr);
 
@@ -493,9 +635,9 @@ ErrorCode ServerController::configureContainerWorker(const ServerCredentials &cr
 
 ErrorCode ServerController::startupContainerWorker(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &config)
 {
-    QString script = amnezia::scriptData(ProtocolScriptType::container_startup, container);
+    const auto script = amnezia::scriptTemplate(ProtocolScriptType::container_startup, container);
 
-    if (script.isEmpty()) {
+    if (script->text().isEmpty()) {
         return ErrorCode::NoError;
     }
 
@@ -513,6 +655,19 @@ ErrorCode ServerController::startupContainerWorker(const ServerCredentials &cred
 ServerController::Vars ServerController::genVarsForScript(const ServerCredentials &credentials, DockerContainer container,
                                                           const QJsonObject &config)
 {
+    // Steps of one operation ask for the same vars many times, the server address is resolved once
+    const QString primaryDns = m_settings->primaryDns();
+    const QString secondaryDns = m_settings->secondaryDns();
+    const QByteArray cacheKey = QStringList({ credentials.hostName, credentials.userName, QString::number(credentials.port),
+                                              QString::number(container), primaryDns, secondaryDns })
+                                        .join('\n')
+                                        .toUtf8()
+            + '\n' + QJsonDocument(config).toJson(QJsonDocument::Compact);
+    const auto cached = m_varsCache.constFind(cacheKey);
+    if (cached != m_varsCache.constEnd()) {
+        return cached.value();
+    }
+
     const QJsonObject &openvpnConfig = config.value(ProtocolProps::protoToString(Proto::OpenVpn)).toObject();
     const QJsonObject &cloakConfig = config.value(ProtocolProps::protoToString(Proto::Cloak)).toObject();
     const QJsonObject &ssConfig = config.value(ProtocolProps::protoToString(Proto::ShadowSocks)).toObject();
@@ -598,8 +753,8 @@ ServerController::Vars ServerController::genVarsForScript(const ServerCredential
 
     vars.append({ { "$IPSEC_VPN_C2C_TRAFFIC", "no" } });
 
-    vars.append({ { "$PRIMARY_SERVER_DNS", m_settings->primaryDns() } });
-    vars.append({ { "$SECONDARY_SERVER_DNS", m_settings->secondaryDns() } });
+    vars.append({ { "$PRIMARY_SERVER_DNS", primaryDns } });
+    vars.append({ { "$SECONDARY_SERVER_DNS", secondaryDns } });
 
     // Sftp vars
     vars.append({ { "$SFTP_PORT", sftpConfig.value(config_key::port).toString(QString::number(ProtocolProps::defaultPort(Proto::Sftp))) } });
@@ -632,6 +787,7 @@ ServerController::Vars ServerController::genVarsForScript(const ServerCredential
             : credentials.hostName;
     if (!serverIp.isEmpty()) {
         vars.append({ { "$SERVER_IP_ADDRESS", serverIp } });
+        m_varsCache.insert(cacheKey, vars);
     } else {
         qWarning() << "ServerController::genVarsForScript unable to resolve address for credentials.hostName";
     }
@@ -656,23 +812,176 @@ QString ServerController::checkSshConnection(const ServerCredentials &credential
     return stdOut;
 }
 
+// Server of a fleet run, shared between the caller and the worker thread
+struct ServerController::FleetTask
+{
+    void abort(bool timeout)
+    {
+        QMutexLocker locker(&mutex);
+        if (aborted) {
+            return;
+        }
+        aborted = true;
+        timedOut = timeout;
+        if (controller) {
+            controller->abortOperations();
+        }
+    }
+
+    qsizetype index = 0;
+    QElapsedTimer elapsed;
+    QString output;
+
+    QMutex mutex;
+    ServerController *controller = nullptr; // set while the operation runs
+    bool aborted = false;
+    bool timedOut = false;
+};
+
+QList<ServerController::FleetResult> ServerController::runOnFleet(const QList<ServerCredentials> &servers,
+                                                                   const FleetOperation &operation, int maxConcurrency,
+                                                                   int hostTimeoutMsec)
+{
+    m_cancelInstallation = false;
+
+    QList<FleetResult> results;
+    results.reserve(servers.size());
+    for (const ServerCredentials &credentials : servers) {
+        FleetResult result;
+        result.credentials = credentials;
+        result.error = ErrorCode::ServerCancelInstallation;
+        results.append(result);
+    }
+
+    // Workers block on their ssh commands, which run on the global pool, so they get a pool of their own
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, maxConcurrency));
+
+    QEventLoop wait;
+    qsizetype next = 0;
+    int finished = 0;
+    std::function<void()> startNext;
+
+    auto onFinished = [&](const std::shared_ptr<FleetTask> &task, QFutureWatcher<ErrorCode> *watcher) {
+        FleetResult &result = results[task->index];
+        if (task->timedOut) {
+            result.error = ErrorCode::SshTimeoutError;
+        } else if (task->aborted) {
+            result.error = ErrorCode::ServerCancelInstallation;
+        } else {
+            result.error = watcher->result();
+        }
+        result.output = task->output;
+        result.elapsedMsec = task->elapsed.elapsed();
+
+        if (result.error != ErrorCode::NoError) {
+            logger.warning() << "Fleet operation failed on" << result.credentials.hostName << "with error" << result.error;
+        }
+
+        m_fleetTasks.removeOne(task);
+        watcher->deleteLater();
+        emit fleetProgress(++finished, servers.size());
+        startNext();
+    };
+
+    startNext = [&]() {
+        while (!m_cancelInstallation && next < servers.size() && m_fleetTasks.size() < pool.maxThreadCount()) {
+            auto task = std::make_shared<FleetTask>();
+            task->index = next++;
+            task->elapsed.start();
+            m_fleetTasks.append(task);
+
+            auto *watcher = new QFutureWatcher<ErrorCode>(&wait);
+            connect(watcher, &QFutureWatcher<ErrorCode>::finished, &wait, [&onFinished, task, watcher]() { onFinished(task, watcher); });
+
+            if (hostTimeoutMsec > 0) {
+                auto *timeout = new QTimer(watcher);
+                timeout->setSingleShot(true);
+                connect(timeout, &QTimer::timeout, watcher, [task]() { task->abort(true); });
+                timeout->start(hostTimeoutMsec);
+            }
+
+            const ServerCredentials credentials = servers.at(task->index);
+            watcher->setFuture(QtConcurrent::run(&pool, [settings = m_settings, credentials, &operation, task]() {
+                ServerController controller(settings);
+                {
+                    QMutexLocker locker(&task->mutex);
+                    if (task->aborted) {
+                        return ErrorCode::ServerCancelInstallation;
+                    }
+                    task->controller = &controller;
+                }
+
+                QString output;
+                const ErrorCode error = operation(controller, credentials, output);
+
+                QMutexLocker locker(&task->mutex);
+                task->controller = nullptr;
+                task->output = output;
+                return error;
+            }));
+        }
+
+        if (m_fleetTasks.isEmpty()) {
+            wait.quit();
+        }
+    };
+
+    startNext();
+    if (!m_fleetTasks.isEmpty()) {
+        wait.exec();
+    }
+
+    return results;
+}
+
+QList<ServerController::FleetResult> ServerController::runScriptOnFleet(const QList<ServerCredentials> &servers, const QString &script,
+                                                                         int maxConcurrency, int hostTimeoutMsec)
+{
+    auto operation = [&script](ServerController &controller, const ServerCredentials &credentials, QString &output) {
+        auto cbReadStd = [&output](const QString &data, libssh::Client &) {
+            output += data + "\n";
+            return ErrorCode::NoError;
+        };
+        return controller.runScript(credentials, controller.replaceVars(script, controller.genVarsForScript(credentials)), cbReadStd,
+                                    cbReadStd);
+    };
+    return runOnFleet(servers, operation, maxConcurrency, hostTimeoutMsec);
+}
+
 void ServerController::cancelInstallation()
 {
     m_cancelInstallation = true;
+    for (const auto &task : std::as_const(m_fleetTasks)) {
+        task->abort(false);
+    }
+
+    // Waiting for the packet manager is interrupted right away, other steps are not
+    if (m_busyWaitLoop) {
+        m_sshClient.abort();
+        m_busyWaitLoop->quit();
+    }
+}
+
+void ServerController::abortOperations()
+{
+    m_cancelInstallation = true;
+    m_sshClient.abort();
 }
 
 ErrorCode ServerController::setupServerFirewall(const ServerCredentials &credentials)
 {
-    return runScript(credentials, replaceVars(amnezia::scriptData(SharedScriptType::setup_host_firewall), genVarsForScript(credentials)));
+    return runScript(credentials, replaceVars(amnezia::scriptTemplate(SharedScriptType::setup_host_firewall), genVarsForScript(credentials)));
 }
 
 QString ServerController::replaceVars(const QString &script, const Vars &vars)
 {
-    QString s = script;
-    for (const QPair<QString, QString> &var : vars) {
-        s.replace(var.first, var.second);
-    }
-    return s;
+    return ScriptTemplate(script).render(vars);
+}
+
+QString ServerController::replaceVars(const std::shared_ptr<const ScriptTemplate> &script, const Vars &vars)
+{
+    return script->render(vars);
 }
 
 ErrorCode ServerController::isServerPortBusy(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &config)
@@ -765,8 +1074,8 @@ ErrorCode ServerController::isUserInSudo(const ServerCredentials &credentials, D
         return ErrorCode::NoError;
     };
 
-    const QString scriptData = amnezia::scriptData(SharedScriptType::check_user_in_sudo);
-    ErrorCode error = runScript(credentials, replaceVars(scriptData, genVarsForScript(credentials)), cbReadStdOut, cbReadStdErr);
+    ErrorCode error = runScript(credentials, replaceVars(amnezia::scriptTemplate(SharedScriptType::check_user_in_sudo), genVarsForScript(credentials)),
+                                cbReadStdOut, cbReadStdErr);
 
     if (!stdOut.contains("sudo"))
         return ErrorCode::ServerUserNotInSudo;
@@ -776,55 +1085,78 @@ ErrorCode ServerController::isUserInSudo(const ServerCredentials &credentials, D
 
 ErrorCode ServerController::isServerDpkgBusy(const ServerCredentials &credentials, DockerContainer container)
 {
-    m_cancelInstallation = false;
     QString stdOut;
-    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
-        stdOut += data + "\n";
-        return ErrorCode::NoError;
-    };
-    auto cbReadStdErr = [&](const QString &data, libssh::Client &) {
+    auto cbReadStd = [&](const QString &data, libssh::Client &) {
         stdOut += data + "\n";
         return ErrorCode::NoError;
     };
 
-    QFutureWatcher<ErrorCode> watcher;
+    // The check script waits on the server until the lock is free or the poll ends, the pauses
+    // after failed polls run in an event loop that cancelInstallation() quits
+    QEventLoop pause;
+    m_busyWaitLoop = &pause;
 
-    QFuture<ErrorCode> future = QtConcurrent::run([this, &stdOut, &cbReadStdOut, &cbReadStdErr, &credentials]() {
-        // max 100 attempts
-        for (int i = 0; i < 30; ++i) {
-            if (m_cancelInstallation) {
-                return ErrorCode::ServerCancelInstallation;
-            }
-            stdOut.clear();
-            runScript(credentials, replaceVars(amnezia::scriptData(SharedScriptType::check_server_is_busy), genVarsForScript(credentials)),
-                      cbReadStdOut, cbReadStdErr);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    int delayMsec = DPKG_RETRY_MIN_DELAY_MSEC;
+    ErrorCode result = ErrorCode::ServerPacketManagerError;
 
-            if (stdOut.contains("Packet manager not found"))
-                return ErrorCode::ServerPacketManagerError;
-            if (stdOut.contains("fuser not installed"))
-                return ErrorCode::NoError;
+    for (int attempt = 1; !m_cancelInstallation; ++attempt) {
+        const qint64 remainingMsec = DPKG_WAIT_TIMEOUT_MSEC - elapsed.elapsed();
+        if (remainingMsec <= 0) {
+            break;
+        }
 
-            if (stdOut.isEmpty()) {
-                return ErrorCode::NoError;
-            } else {
+        Vars vars = genVarsForScript(credentials);
+        vars.append({ "$LOCK_WAIT_TIMEOUT", QString::number(qMax<qint64>(1, qMin<qint64>(DPKG_LONG_POLL_MSEC, remainingMsec) / 1000)) });
+
+        stdOut.clear();
+        const ErrorCode error = runScript(credentials, replaceVars(amnezia::scriptTemplate(SharedScriptType::check_server_is_busy), vars),
+                                          cbReadStd, cbReadStd);
+        if (m_cancelInstallation) {
+            break;
+        }
+
+        if (error == ErrorCode::NoError) {
+            if (stdOut.contains("Packet manager not found")) {
+                result = ErrorCode::ServerPacketManagerError;
+                break;
+            }
+            if (stdOut.contains("fuser not installed") || stdOut.trimmed().isEmpty()) {
+                result = ErrorCode::NoError;
+                break;
+            }
 #ifdef MZ_DEBUG
-                qDebug().noquote() << stdOut;
+            qDebug().noquote() << stdOut;
 #endif
-                emit serverIsBusy(true);
-                QThread::msleep(10000);
-            }
+        } else {
+            logger.warning() << "Failed to check the packet manager lock, attempt" << attempt << "error" << error;
         }
-        return ErrorCode::ServerPacketManagerError;
-    });
 
-    QEventLoop wait;
-    QObject::connect(&watcher, &QFutureWatcher<ErrorCode>::finished, &wait, &QEventLoop::quit);
-    watcher.setFuture(future);
-    wait.exec();
+        emit serverIsBusy(true);
+        emit serverBusyWaitProgress(attempt, elapsed.elapsed(), DPKG_WAIT_TIMEOUT_MSEC);
+
+        // A poll that ran to its end has already waited on the server, the next one starts
+        // right away. Only failed polls are retried with a backoff.
+        if (error == ErrorCode::NoError) {
+            delayMsec = DPKG_RETRY_MIN_DELAY_MSEC;
+            continue;
+        }
+
+        // Exponential backoff with jitter, so that many clients do not poll a server in step
+        const int jitterMsec = QRandomGenerator::global()->bounded(delayMsec / 2 + 1);
+        QTimer::singleShot(delayMsec / 2 + jitterMsec, &pause, &QEventLoop::quit);
+        pause.exec();
+        delayMsec = qMin(delayMsec * 2, DPKG_RETRY_MAX_DELAY_MSEC);
+    }
 
+    // Nothing can abort the client past this point, the commands that follow (the cleanup
+    // after a cancel among them) must not be refused
+    m_busyWaitLoop = nullptr;
+    m_sshClient.resetAbort();
     emit serverIsBusy(false);
 
-    return future.result();
+    return m_cancelInstallation ? ErrorCode::ServerCancelInstallation : result;
 }
 
 ErrorCode ServerController::getDecryptedPrivateKey(const ServerCredentials &credentials, QString &decryptedPrivateKey,
@@ -1,13 +1,20 @@
 #ifndef SERVERCONTROLLER_H
 #define SERVERCONTROLLER_H
 
+#include <QHash>
 #include <QJsonObject>
 #include <QObject>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+
 #include "containers/containers_defs.h"
 #include "core/defs.h"
+#include "core/scripttemplate.h"
 #include "core/sshclient.h"
 
+class QEventLoop;
 class Settings;
 class VpnConfigurator;
 
@@ -20,7 +27,7 @@ public:
     ServerController(std::shared_ptr<Settings> settings, QObject *parent = nullptr);
     ~ServerController();
 
-    typedef QList<QPair<QString, QString>> Vars;
+    typedef ScriptTemplate::Vars Vars;
 
     ErrorCode rebootServer(const ServerCredentials &credentials);
     ErrorCode removeAllContainers(const ServerCredentials &credentials);
@@ -38,13 +45,25 @@ public:
     QByteArray getTextFileFromContainer(DockerContainer container, const ServerCredentials &credentials, const QString &path,
                                         ErrorCode &errorCode);
 
+    static constexpr qint64 DEFAULT_DOWNLOAD_LIMIT = 16 * 1024 * 1024;
+
+    // Streams the file out of the container as raw bytes and verifies its POSIX cksum.
+    // A missing file gives empty data and no error.
+    ErrorCode downloadFileFromContainer(DockerContainer container, const ServerCredentials &credentials, const QString &path,
+                                        QByteArray &data, qint64 maxSize = DEFAULT_DOWNLOAD_LIMIT);
+
     QString replaceVars(const QString &script, const Vars &vars);
+    QString replaceVars(const std::shared_ptr<const ScriptTemplate> &script, const Vars &vars);
     Vars genVarsForScript(const ServerCredentials &credentials, DockerContainer container = DockerContainer::None,
                           const QJsonObject &config = QJsonObject());
 
+    // The whole script is sent in one exec, every command (a line or lines joined with '\')
+    // runs in its own subshell like it did as a separate exec. stepExitCodes receives
+    // the exit code of every command.
     ErrorCode runScript(const ServerCredentials &credentials, QString script,
                         const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut = nullptr,
-                        const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr = nullptr);
+                        const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr = nullptr,
+                        QList<int> *stepExitCodes = nullptr);
 
     ErrorCode runContainerScript(const ServerCredentials &credentials, DockerContainer container, QString script,
                                  const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut = nullptr,
@@ -52,6 +71,30 @@ public:
 
     QString checkSshConnection(const ServerCredentials &credentials, ErrorCode &errorCode);
 
+    struct FleetResult
+    {
+        ServerCredentials credentials;
+        ErrorCode error = ErrorCode::NoError;
+        QString output;
+        qint64 elapsedMsec = 0;
+    };
+
+    // Runs in a worker thread with a controller of its own, output goes to FleetResult::output
+    typedef std::function<ErrorCode(ServerController &controller, const ServerCredentials &credentials, QString &output)> FleetOperation;
+
+    static constexpr int DEFAULT_FLEET_CONCURRENCY = 8;
+    static constexpr int DEFAULT_FLEET_HOST_TIMEOUT_MSEC = 5 * 60 * 1000;
+
+    // Runs the operation on every server, at most maxConcurrency servers at a time, and returns
+    // the results in the order of servers. A server that takes longer than hostTimeoutMsec is
+    // interrupted with SshTimeoutError. cancelInstallation() interrupts the running servers and
+    // skips the rest, all of them get ServerCancelInstallation.
+    QList<FleetResult> runOnFleet(const QList<ServerCredentials> &servers, const FleetOperation &operation,
+                                  int maxConcurrency = DEFAULT_FLEET_CONCURRENCY, int hostTimeoutMsec = DEFAULT_FLEET_HOST_TIMEOUT_MSEC);
+    QList<FleetResult> runScriptOnFleet(const QList<ServerCredentials> &servers, const QString &script,
+                                        int maxConcurrency = DEFAULT_FLEET_CONCURRENCY,
+                                        int hostTimeoutMsec = DEFAULT_FLEET_HOST_TIMEOUT_MSEC);
+
     void cancelInstallation();
 
     ErrorCode getDecryptedPrivateKey(const ServerCredentials &credentials, QString &decryptedPrivateKey,
@@ -75,13 +118,27 @@ private:
 
     ErrorCode setupServerFirewall(const ServerCredentials &credentials);
 
+    struct FleetTask;
+    // Aborts the ssh client for good, only for the throwaway controllers of a fleet run
+    void abortOperations();
+
+    static constexpr qint64 DPKG_WAIT_TIMEOUT_MSEC = 5 * 60 * 1000;
+    static constexpr qint64 DPKG_LONG_POLL_MSEC = 30 * 1000;
+    static constexpr int DPKG_RETRY_MIN_DELAY_MSEC = 1000;
+    static constexpr int DPKG_RETRY_MAX_DELAY_MSEC = 16 * 1000;
+
     std::shared_ptr<Settings> m_settings;
     std::shared_ptr<VpnConfigurator> m_configurator;
 
-    bool m_cancelInstallation = false;
+    std::atomic<bool> m_cancelInstallation { false };
     libssh::Client m_sshClient;
+    QList<std::shared_ptr<FleetTask>> m_fleetTasks;
+    QEventLoop *m_busyWaitLoop = nullptr; // set while isServerDpkgBusy() waits
+    QHash<QByteArray, Vars> m_varsCache;
 signals:
     void serverIsBusy(const bool isBusy);
+    void serverBusyWaitProgress(int attempt, qint64 elapsedMsec, qint64 timeoutMsec);
+    void fleetProgress(int finished, int total);
 };
 
 #endif // SERVERCONTROLLER_H
@@ -56,6 +56,9 @@ namespace amnezia
         ServerCancelInstallation = 204,
         ServerUserNotInSudo = 205,
         ServerPacketManagerError = 206,
+        ServerFileTooLargeError = 207,
+        ServerFileChecksumError = 208,
+        ServerFileWriteError = 209,
 
         // Ssh connection errors
         SshRequestDeniedError = 300,
@@ -21,6 +21,9 @@ QString errorString(ErrorCode code) {
     case(ErrorCode::ServerCancelInstallation): errorMessage = QObject::tr("Installation canceled by user"); break;
     case(ErrorCode::ServerUserNotInSudo): errorMessage = QObject::tr("The user does not have permission to use sudo"); break;
     case(ErrorCode::ServerPacketManagerError): errorMessage = QObject::tr("Server error: Packet manager error"); break;
+    case(ErrorCode::ServerFileTooLargeError): errorMessage = QObject::tr("Server error: File is too large to download"); break;
+    case(ErrorCode::ServerFileChecksumError): errorMessage = QObject::tr("Server error: Downloaded file is damaged"); break;
+    case(ErrorCode::ServerFileWriteError): errorMessage = QObject::tr("Server error: Failed to write a file to the container"); break;
 
     // Libssh errors
     case(ErrorCode::SshRequestDeniedError): errorMessage = QObject::tr("SSH request was denied"); break;
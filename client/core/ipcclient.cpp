@@ -13,6 +13,60 @@ IpcClient::~IpcClient()
     if (m_localSocket) m_localSocket->close();
 }
 
+void IpcClient::routeAddPrefixes(const QString &gw, const QByteArray &prefixes)
+{
+    sendRoutePrefixes(true, gw, prefixes);
+}
+
+void IpcClient::routeDeletePrefixes(const QString &gw, const QByteArray &prefixes)
+{
+    sendRoutePrefixes(false, gw, prefixes);
+}
+
+void IpcClient::sendRoutePrefixes(bool add, const QString &gw, const QByteArray &prefixes)
+{
+    if (!Instance() || !Interface()) return;
+
+    const int total = amnezia::routePrefixCount(prefixes);
+    const int chunkSize = amnezia::ROUTE_PREFIX_CHUNK * amnezia::ROUTE_PREFIX_SIZE;
+
+    // Chunks are queued at once, the service handles them in order
+    auto done = QSharedPointer<QPair<int, int>>::create(0, 0);
+    for (qsizetype offset = 0; offset < prefixes.size(); offset += chunkSize) {
+        const QByteArray chunk = prefixes.mid(offset, chunkSize);
+        QRemoteObjectPendingReply<int> reply = add
+                ? call("routeAddPrefixes", &IpcInterfaceReplica::routeAddPrefixes, gw, chunk)
+                : call("routeDeletePrefixes", &IpcInterfaceReplica::routeDeletePrefixes, gw, chunk);
+
+        const int count = amnezia::routePrefixCount(chunk);
+        auto watcher = new QRemoteObjectPendingCallWatcher(reply, Instance());
+        connect(watcher, &QRemoteObjectPendingCallWatcher::finished, Instance(),
+                [add, gw, count, total, done](QRemoteObjectPendingCallWatcher *watcher) {
+                    done->first += count;
+                    done->second += watcher->returnValue().toInt();
+                    emit Instance()->routesProgress(gw, done->first, done->second, total);
+                    if (add && done->first == total && done->second != total) {
+                        qWarning() << "IpcClient: applied" << done->second << "of" << total << "routes via" << gw;
+                    }
+                    watcher->deleteLater();
+                });
+    }
+}
+
+void IpcClient::traceReply(const char *slot, const QRemoteObjectPendingCall &reply, const QElapsedTimer &timer, qint64 payload)
+{
+    if (reply.isFinished() || !Instance()) {
+        IpcCallTrace::instance()->record(slot, timer.nsecsElapsed() / 1000, payload);
+        return;
+    }
+
+    auto watcher = new QRemoteObjectPendingCallWatcher(reply, Instance());
+    connect(watcher, &QRemoteObjectPendingCallWatcher::finished, Instance(), [slot, timer, payload](QRemoteObjectPendingCallWatcher *watcher) {
+        IpcCallTrace::instance()->record(slot, timer.nsecsElapsed() / 1000, payload);
+        watcher->deleteLater();
+    });
+}
+
 bool IpcClient::isSocketConnected() const
 {
     return m_isSocketConnected;
@@ -82,41 +136,29 @@ QSharedPointer<PrivilegedProcess> IpcClient::CreatePrivilegedProcess()
         return nullptr;
     }
 
-    QRemoteObjectPendingReply<int> futureResult = Instance()->m_ipcClient->createPrivilegedProcess();
+    QRemoteObjectPendingReply<int> futureResult = call("createPrivilegedProcess", &IpcInterfaceReplica::createPrivilegedProcess);
     futureResult.waitForFinished(5000);
 
     int pid = futureResult.returnValue();
+    if (pid <= 0) {
+        qWarning() << "IpcClient::createPrivilegedProcess : the service failed to create the process";
+        return nullptr;
+    }
 
-    auto pd = QSharedPointer<ProcessDescriptor>(new ProcessDescriptor());
-    Instance()->m_processNodes.insert(pid, pd);
-
-    pd->localSocket.reset(new QLocalSocket(pd->replicaNode.data()));
-
-    connect(pd->localSocket.data(), &QLocalSocket::connected, pd->replicaNode.data(), [pd]() {
-        pd->replicaNode->addClientSideConnection(pd->localSocket.data());
-
-        IpcProcessInterfaceReplica *repl = pd->replicaNode->acquire<IpcProcessInterfaceReplica>();
-        PrivilegedProcess *priv = static_cast<PrivilegedProcess *>(repl);
-        pd->ipcProcess.reset(priv);
-        if (!pd->ipcProcess) {
-            qWarning() << "Acquire PrivilegedProcess failed";
-        }
-        else {
-            pd->ipcProcess->waitForSource(1000);
-            if (!pd->ipcProcess->isReplicaValid()) {
-                qWarning() << "PrivilegedProcess replica is not connected!";
-            }
-
-            QObject::connect(pd->ipcProcess.data(), &PrivilegedProcess::destroyed, pd->ipcProcess.data(), [pd](){
-                pd->replicaNode->deleteLater();
-            });
-        }
+    // The process source is remoted on the service host under its own name,
+    // so it is acquired through the node that is already connected
+    IpcProcessInterfaceReplica *repl = Instance()->m_ClientNode.acquire<IpcProcessInterfaceReplica>(amnezia::getIpcProcessName(pid));
+    auto processReplica = QSharedPointer<PrivilegedProcess>(static_cast<PrivilegedProcess *>(repl));
+    if (!processReplica) {
+        qWarning() << "Acquire PrivilegedProcess failed";
+        return nullptr;
+    }
 
-    });
-    pd->localSocket->connectToServer(amnezia::getIpcProcessUrl(pid));
-    pd->localSocket->waitForConnected();
+    processReplica->waitForSource(1000);
+    if (!processReplica->isReplicaValid()) {
+        qWarning() << "PrivilegedProcess replica is not connected!";
+    }
 
-    auto processReplica = QSharedPointer<PrivilegedProcess>(pd->ipcProcess);
     return processReplica;
 }
 
@@ -1,10 +1,13 @@
 #ifndef IPCCLIENT_H
 #define IPCCLIENT_H
 
+#include <QElapsedTimer>
 #include <QLocalSocket>
 #include <QObject>
 
 #include "ipc.h"
+#include "ipccalltrace.h"
+#include "routeprefixes.h"
 #include "rep_ipc_interface_replica.h"
 #include "rep_ipc_process_tun2socks_replica.h"
 
@@ -22,13 +25,38 @@ public:
    static QSharedPointer<IpcProcessTun2SocksReplica> InterfaceTun2Socks();
    static QSharedPointer<PrivilegedProcess> CreatePrivilegedProcess();
 
+   // Calls a slot of the interface replica and records its round trip and payload in IpcCallTrace
+   template <typename R, typename... Params, typename... Args>
+   static QRemoteObjectPendingReply<R> call(const char *slot, QRemoteObjectPendingReply<R> (IpcInterfaceReplica::*method)(Params...),
+                                            Args &&...args)
+   {
+       QSharedPointer<IpcInterfaceReplica> iface = Interface();
+       if (!iface) return QRemoteObjectPendingReply<R>();
+
+       qint64 payload = IpcCallTrace::payloadSize(args...);
+       QElapsedTimer timer;
+       timer.start();
+       QRemoteObjectPendingReply<R> reply = (iface.data()->*method)(std::forward<Args>(args)...);
+       traceReply(slot, reply, timer, payload);
+       return reply;
+   }
+
+   // Sends packed prefixes (see routeprefixes.h) in chunks of ROUTE_PREFIX_CHUNK,
+   // routesProgress is emitted as the service applies them
+   static void routeAddPrefixes(const QString &gw, const QByteArray &prefixes);
+   static void routeDeletePrefixes(const QString &gw, const QByteArray &prefixes);
+
    bool isSocketConnected() const;
 
 signals:
+   void routesProgress(const QString &gw, int done, int applied, int total);
 
 private:
     ~IpcClient() override;
 
+    static void sendRoutePrefixes(bool add, const QString &gw, const QByteArray &prefixes);
+    static void traceReply(const char *slot, const QRemoteObjectPendingCall &reply, const QElapsedTimer &timer, qint64 payload);
+
     QRemoteObjectNode m_ClientNode;
     QRemoteObjectNode m_Tun2SocksNode;
     QSharedPointer<IpcInterfaceReplica> m_ipcClient;
@@ -36,18 +64,6 @@ private:
     QPointer<QLocalSocket> m_tun2socksSocket;
     QSharedPointer<IpcProcessTun2SocksReplica> m_Tun2SocksClient;
 
-    struct ProcessDescriptor {
-        ProcessDescriptor () {
-            replicaNode = QSharedPointer<QRemoteObjectNode>(new QRemoteObjectNode());
-            ipcProcess = QSharedPointer<PrivilegedProcess>();
-            localSocket = QSharedPointer<QLocalSocket>();
-        }
-        QSharedPointer<PrivilegedProcess> ipcProcess;
-        QSharedPointer<QRemoteObjectNode> replicaNode;
-        QSharedPointer<QLocalSocket> localSocket;
-    };
-
-    QMap<int, QSharedPointer<ProcessDescriptor>> m_processNodes;
     bool m_isSocketConnected {false};
 
     static IpcClient *m_instance;
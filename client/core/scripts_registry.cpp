@@ -2,8 +2,28 @@
 
 #include <QDebug>
 #include <QFile>
+#include <QHash>
+#include <QMutex>
 #include <QObject>
 
+#include <functional>
+
+namespace
+{
+    std::shared_ptr<const ScriptTemplate> cachedTemplate(const QString &key, const std::function<QString()> &load)
+    {
+        static QMutex mutex;
+        static QHash<QString, std::shared_ptr<const ScriptTemplate>> templates;
+
+        QMutexLocker locker(&mutex);
+        auto it = templates.constFind(key);
+        if (it == templates.constEnd()) {
+            it = templates.insert(key, std::make_shared<const ScriptTemplate>(load()));
+        }
+        return it.value();
+    }
+}
+
 QString amnezia::scriptFolder(amnezia::DockerContainer container)
 {
     switch (container) {
@@ -81,3 +101,14 @@ QString amnezia::scriptData(amnezia::ProtocolScriptType type, DockerContainer co
     data.replace("\r", "");
     return data;
 }
+
+std::shared_ptr<const ScriptTemplate> amnezia::scriptTemplate(amnezia::SharedScriptType type)
+{
+    return cachedTemplate(amnezia::scriptName(type), [type]() { return amnezia::scriptData(type); });
+}
+
+std::shared_ptr<const ScriptTemplate> amnezia::scriptTemplate(amnezia::ProtocolScriptType type, DockerContainer container)
+{
+    return cachedTemplate(QString("%1/%2").arg(amnezia::scriptFolder(container), amnezia::scriptName(type)),
+                          [type, container]() { return amnezia::scriptData(type, container); });
+}
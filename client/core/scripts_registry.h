@@ -2,7 +2,11 @@
 #define SCRIPTS_REGISTRY_H
 
 #include <QLatin1String>
+
+#include <memory>
+
 #include "core/defs.h"
+#include "core/scripttemplate.h"
 #include "containers/containers_defs.h"
 
 namespace amnezia {
@@ -39,6 +43,10 @@ QString scriptName(ProtocolScriptType type);
 
 QString scriptData(SharedScriptType type);
 QString scriptData(ProtocolScriptType type, DockerContainer container);
+
+// Prepared once per script and kept for the lifetime of the app
+std::shared_ptr<const ScriptTemplate> scriptTemplate(SharedScriptType type);
+std::shared_ptr<const ScriptTemplate> scriptTemplate(ProtocolScriptType type, DockerContainer container);
 }
 
 #endif // SCRIPTS_REGISTRY_H
@@ -0,0 +1,88 @@
+#include "scripttemplate.h"
+
+#include <QHash>
+#include <QStringView>
+
+namespace
+{
+    bool isNameChar(QChar c)
+    {
+        return c.isLetterOrNumber() || c == '_';
+    }
+}
+
+ScriptTemplate::ScriptTemplate(const QString &text) : m_text(text)
+{
+    qsizetype literalStart = 0;
+    qsizetype i = 0;
+    while (i < m_text.size()) {
+        if (m_text.at(i) != '$') {
+            i++;
+            continue;
+        }
+
+        qsizetype end = i + 1;
+        while (end < m_text.size() && isNameChar(m_text.at(end))) {
+            end++;
+        }
+        if (end == i + 1) {
+            i++;
+            continue;
+        }
+
+        if (i > literalStart) {
+            m_segments.append({ literalStart, i - literalStart, false });
+        }
+        m_segments.append({ i, end - i, true });
+        literalStart = i = end;
+    }
+
+    if (literalStart < m_text.size()) {
+        m_segments.append({ literalStart, m_text.size() - literalStart, false });
+    }
+}
+
+QString ScriptTemplate::render(const Vars &vars) const
+{
+    QHash<QStringView, QStringView> values;
+    values.reserve(vars.size());
+    qsizetype maxNameLength = 0;
+    qsizetype valuesSize = 0;
+    for (const QPair<QString, QString> &var : vars) {
+        const QStringView name(var.first);
+        if (!values.contains(name)) {
+            values.insert(name, QStringView(var.second));
+            maxNameLength = qMax(maxNameLength, name.size());
+            valuesSize += var.second.size();
+        }
+    }
+
+    QString result;
+    result.reserve(m_text.size() + valuesSize);
+
+    const QStringView text(m_text);
+    for (const Segment &segment : m_segments) {
+        const QStringView token = text.mid(segment.start, segment.length);
+        if (!segment.isVar) {
+            result.append(token);
+            continue;
+        }
+
+        // Names are matched as substrings by the callers, "$PORT" is replaced in "$PORT_2"
+        // when only "$PORT" is known, so the longest known prefix of the token is taken
+        qsizetype length = qMin(token.size(), maxNameLength);
+        for (; length > 1; --length) {
+            const auto it = values.constFind(token.left(length));
+            if (it != values.cend()) {
+                result.append(it.value());
+                result.append(token.mid(length));
+                break;
+            }
+        }
+        if (length <= 1) {
+            result.append(token);
+        }
+    }
+
+    return result;
+}
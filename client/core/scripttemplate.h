@@ -0,0 +1,38 @@
+#ifndef SCRIPTTEMPLATE_H
+#define SCRIPTTEMPLATE_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+
+/**
+ * @brief The ScriptTemplate class - Server script split into text and $VARS once
+ *
+ * render() substitutes all variables in a single pass over the prepared segments.
+ * At every '$' the longest known name is replaced and the first definition of a name
+ * wins. Substituted values are not scanned for variables again, otherwise the result
+ * is the same as replacing the variables one by one in list order.
+ */
+class ScriptTemplate
+{
+public:
+    typedef QList<QPair<QString, QString>> Vars;
+
+    explicit ScriptTemplate(const QString &text);
+
+    const QString &text() const { return m_text; }
+    QString render(const Vars &vars) const;
+
+private:
+    struct Segment
+    {
+        qsizetype start = 0;
+        qsizetype length = 0;
+        bool isVar = false; // '$' followed by letters, digits or '_'
+    };
+
+    QString m_text;
+    QList<Segment> m_segments;
+};
+
+#endif // SCRIPTTEMPLATE_H
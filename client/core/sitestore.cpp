@@ -0,0 +1,252 @@
+#include "sitestore.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+
+namespace
+{
+    // Journal records, one per line: "+site\tip", "-site" or "*" to clear the list
+    constexpr char insertRecord = '+';
+    constexpr char removeRecord = '-';
+    constexpr char clearRecord = '*';
+}
+
+SiteStore::SiteStore(const QString &journalPath) : m_journal(journalPath)
+{
+}
+
+void SiteStore::load(const QVariantMap &snapshot)
+{
+    QMutexLocker locker(&m_mutex);
+
+    fill(snapshot);
+
+    m_journalRecords = 0;
+    m_journal.close();
+    if (m_journal.open(QIODevice::ReadOnly)) {
+        while (!m_journal.atEnd()) {
+            const QString line = QString::fromUtf8(m_journal.readLine()).trimmed();
+            if (line.isEmpty()) {
+                continue;
+            }
+
+            const QStringView record = QStringView(line).mid(1);
+            if (line.at(0) == insertRecord) {
+                const qsizetype tab = record.indexOf('\t');
+                insertEntry(record.left(tab).toString(), tab < 0 ? QString() : record.mid(tab + 1).toString());
+            } else if (line.at(0) == removeRecord) {
+                removeEntry(record.toString());
+            } else if (line.at(0) == clearRecord) {
+                clearEntries();
+            }
+            m_journalRecords++;
+        }
+        m_journal.close();
+    }
+
+    QDir().mkpath(QFileInfo(m_journal.fileName()).absolutePath());
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "SiteStore: unable to open journal" << m_journal.fileName() << m_journal.errorString();
+    }
+}
+
+void SiteStore::replace(const QVariantMap &snapshot)
+{
+    QMutexLocker locker(&m_mutex);
+    fill(snapshot);
+}
+
+int SiteStore::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+bool SiteStore::contains(const QString &site) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.contains(site);
+}
+
+bool SiteStore::containsAddress(const QString &ip) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_addresses.contains(ip);
+}
+
+bool SiteStore::insert(const QString &site, const QString &ip)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!insertEntry(site, ip)) {
+        return false;
+    }
+    appendJournal(insertRecord + site.toUtf8() + '\t' + ip.toUtf8());
+    return true;
+}
+
+bool SiteStore::remove(const QString &site)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!removeEntry(site)) {
+        return false;
+    }
+    appendJournal(removeRecord + site.toUtf8());
+    return true;
+}
+
+void SiteStore::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    clearEntries();
+    appendJournal(QByteArray(1, clearRecord));
+}
+
+QVariantMap SiteStore::toMap() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap map;
+    for (auto i = m_entries.constBegin(); i != m_entries.constEnd(); ++i) {
+        map.insert(i.key(), i.value().ip);
+    }
+    return map;
+}
+
+QStringList SiteStore::domains() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList domains;
+    for (auto i = m_entries.constBegin(); i != m_entries.constEnd(); ++i) {
+        if (i.value().type == Type::Domain) {
+            domains.append(i.key());
+        }
+    }
+    return domains;
+}
+
+QStringList SiteStore::ips() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_addresses.keys();
+}
+
+QByteArray SiteStore::routePrefixes() const
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray buffer;
+    buffer.reserve(m_addresses.size() * amnezia::ROUTE_PREFIX_SIZE);
+    for (const Address &address : m_addresses) {
+        buffer.append(static_cast<char>(address.prefix.family));
+        buffer.append(static_cast<char>(address.prefix.length));
+        buffer.append(reinterpret_cast<const char *>(address.prefix.address), sizeof(address.prefix.address));
+    }
+    return buffer;
+}
+
+bool SiteStore::needsCompaction() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_journalRecords >= qMax(MIN_COMPACTION_RECORDS, static_cast<int>(m_entries.size()) / 2);
+}
+
+void SiteStore::resetJournal()
+{
+    QMutexLocker locker(&m_mutex);
+    m_journal.close();
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "SiteStore: unable to reset journal" << m_journal.fileName() << m_journal.errorString();
+    }
+    m_journalRecords = 0;
+}
+
+bool SiteStore::insertEntry(const QString &site, const QString &ip)
+{
+    if (site.isEmpty()) {
+        return false;
+    }
+
+    auto it = m_entries.find(site);
+    if (it != m_entries.end()) {
+        if (it.value().ip == ip) {
+            return false;
+        }
+        removeAddress(routedAddress(site, it.value()));
+        it.value().ip = ip;
+        addAddress(routedAddress(site, it.value()));
+        return true;
+    }
+
+    amnezia::RoutePrefix prefix;
+    Entry entry;
+    entry.type = amnezia::parseIPv4Prefix(site, prefix) ? Type::Prefix : Type::Domain;
+    entry.ip = ip;
+    addAddress(routedAddress(site, entry));
+    m_entries.insert(site, entry);
+    return true;
+}
+
+bool SiteStore::removeEntry(const QString &site)
+{
+    const auto it = m_entries.constFind(site);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+    removeAddress(routedAddress(site, it.value()));
+    m_entries.erase(it);
+    return true;
+}
+
+void SiteStore::fill(const QVariantMap &snapshot)
+{
+    clearEntries();
+    m_entries.reserve(snapshot.size());
+    for (auto i = snapshot.constBegin(); i != snapshot.constEnd(); ++i) {
+        insertEntry(i.key(), i.value().toString());
+    }
+}
+
+void SiteStore::clearEntries()
+{
+    m_entries.clear();
+    m_addresses.clear();
+}
+
+QString SiteStore::routedAddress(const QString &site, const Entry &entry)
+{
+    return entry.type == Type::Prefix ? site : entry.ip;
+}
+
+void SiteStore::addAddress(const QString &ip)
+{
+    if (ip.isEmpty()) {
+        return;
+    }
+
+    auto it = m_addresses.find(ip);
+    if (it == m_addresses.end()) {
+        Address address;
+        if (!amnezia::parseIPv4Prefix(ip, address.prefix)) {
+            return;
+        }
+        it = m_addresses.insert(ip, address);
+    }
+    it.value().refs++;
+}
+
+void SiteStore::removeAddress(const QString &ip)
+{
+    auto it = m_addresses.find(ip);
+    if (it != m_addresses.end() && --it.value().refs == 0) {
+        m_addresses.erase(it);
+    }
+}
+
+void SiteStore::appendJournal(const QByteArray &record)
+{
+    if (!m_journal.isOpen()) {
+        return;
+    }
+    m_journal.write(record + '\n');
+    m_journal.flush();
+    m_journalRecords++;
+}
@@ -0,0 +1,92 @@
+#ifndef SITESTORE_H
+#define SITESTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "routeprefixes.h"
+
+/**
+ * @brief The SiteStore class - Indexed split tunneling list of one route mode
+ *
+ * Every entry is classified once when it is added: either an IPv4 address/subnet
+ * or a domain with its last resolved address. Addresses are kept in a reference
+ * counted set of parsed prefixes, ready for routing without re-parsing.
+ *
+ * Changes are appended to a journal file next to the settings. The full list is
+ * written as a snapshot by the owner only when needsCompaction() says so, then
+ * the journal is truncated. On load the journal is replayed over the snapshot,
+ * replaying it over a newer snapshot gives the same result.
+ */
+class SiteStore
+{
+public:
+    enum class Type {
+        Prefix,
+        Domain
+    };
+
+    struct Entry
+    {
+        Type type = Type::Domain;
+        QString ip; // resolved address of a domain, as stored by the user for a prefix
+    };
+
+    explicit SiteStore(const QString &journalPath);
+
+    // Fills the store from the snapshot and replays the journal
+    void load(const QVariantMap &snapshot);
+    // Replaces the whole list without journaling, the owner saves the snapshot
+    // and calls resetJournal() afterwards
+    void replace(const QVariantMap &snapshot);
+
+    int size() const;
+    bool contains(const QString &site) const;
+    // True when the address is routed, as a prefix entry or as the address of a domain
+    bool containsAddress(const QString &ip) const;
+
+    // Both return true when the store has changed
+    bool insert(const QString &site, const QString &ip = QString());
+    bool remove(const QString &site);
+    void clear();
+
+    QVariantMap toMap() const;
+    QStringList domains() const;
+    QStringList ips() const;
+    QByteArray routePrefixes() const;
+
+    bool needsCompaction() const;
+    // Called by the owner after the snapshot returned by toMap() is saved
+    void resetJournal();
+
+private:
+    static constexpr int MIN_COMPACTION_RECORDS = 1024;
+
+    struct Address
+    {
+        int refs = 0;
+        amnezia::RoutePrefix prefix;
+    };
+
+    bool insertEntry(const QString &site, const QString &ip);
+    bool removeEntry(const QString &site);
+    void fill(const QVariantMap &snapshot);
+    void clearEntries();
+    static QString routedAddress(const QString &site, const Entry &entry);
+    void addAddress(const QString &ip);
+    void removeAddress(const QString &ip);
+    void appendJournal(const QByteArray &record);
+
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_entries;
+    QHash<QString, Address> m_addresses;
+
+    QFile m_journal;
+    int m_journalRecords = 0;
+};
+
+#endif // SITESTORE_H
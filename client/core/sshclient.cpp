@@ -1,5 +1,9 @@
 #include "sshclient.h"
 
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QEventLoop>
 #include <QtConcurrent>
 
@@ -21,87 +25,269 @@ namespace libssh {
         return 0;
     }
 
-    ErrorCode Client::connectToHost(const ServerCredentials &credentials)
+    namespace {
+        // Holds the session mutex for the libssh calls of a client, if it has a session
+        class SessionLock
+        {
+        public:
+            explicit SessionLock(const std::shared_ptr<Session> &session) : m_session(session)
+            {
+                if (m_session) {
+                    m_session->mutex.lock();
+                }
+            }
+            ~SessionLock()
+            {
+                if (m_session) {
+                    m_session->mutex.unlock();
+                }
+            }
+
+        private:
+            std::shared_ptr<Session> m_session;
+        };
+
+        constexpr int readTimeoutMsec = 50;
+        // Quiet time after which an unfinished line is taken for a prompt. It is much longer
+        // than a network stall inside a line, which would otherwise split the line in two.
+        constexpr int promptIdleMsec = 2000;
+        constexpr int minReadBufferSize = 16 * 1024;
+        constexpr int maxReadBufferSize = 256 * 1024;
+        constexpr int maxWriteChunkSize = 32 * 1024;
+    }
+
+    Session::~Session()
     {
-        if (m_session != nullptr) {
-            if (!ssh_is_connected(m_session)) {
-                ssh_free(m_session);
-                m_session = nullptr;
+        if (handle != nullptr) {
+            if (ssh_is_connected(handle)) {
+                ssh_disconnect(handle);
             }
+            ssh_free(handle);
         }
+    }
 
-        if (m_session == nullptr) {
-            m_session = ssh_new();
+    SessionPool *SessionPool::instance()
+    {
+        static SessionPool *pool = []() {
+            auto pool = new SessionPool();
+            if (QCoreApplication::instance()) {
+                pool->moveToThread(QCoreApplication::instance()->thread());
+            }
+            QMetaObject::invokeMethod(pool, [pool]() {
+                pool->m_timer = new QTimer(pool);
+                connect(pool->m_timer, &QTimer::timeout, pool, &SessionPool::maintain);
+                pool->m_timer->start(KEEPALIVE_INTERVAL_MSEC);
+            });
+            return pool;
+        }();
+        return pool;
+    }
+
+    SessionPool::SessionPool()
+    {
+    }
+
+    QByteArray SessionPool::key(const ServerCredentials &credentials)
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        hash.addData(credentials.hostName.toUtf8() + '\n' + QByteArray::number(credentials.port) + '\n'
+                     + credentials.userName.toUtf8() + '\n' + credentials.secretData.toUtf8());
+        return hash.result();
+    }
 
-            if (m_session == nullptr) {
-                qDebug() << "Failed to create ssh session";
-                return ErrorCode::InternalError;
+    std::shared_ptr<Session> SessionPool::acquire(const QByteArray &key)
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_sessions.find(key); it != m_sessions.end() && it.key() == key; ++it) {
+            const std::shared_ptr<Session> &session = it.value();
+            if (session->users >= MAX_CHANNELS) {
+                continue;
             }
 
-            int port = credentials.port;
-            int logVerbosity = SSH_LOG_NOLOG;
-            std::string hostIp = credentials.hostName.toStdString();
-            std::string hostUsername = credentials.userName.toStdString() + "@" + hostIp;
+            QMutexLocker sessionLocker(&session->mutex);
+            if (!session->failed && ssh_is_connected(session->handle)) {
+                session->users++;
+                session->lastUsedMsec = QDateTime::currentMSecsSinceEpoch();
+                return session;
+            }
+        }
+        return nullptr;
+    }
 
-            ssh_options_set(m_session, SSH_OPTIONS_HOST, hostIp.c_str());
-            ssh_options_set(m_session, SSH_OPTIONS_PORT, &port);
-            ssh_options_set(m_session, SSH_OPTIONS_USER, hostUsername.c_str());
-            ssh_options_set(m_session, SSH_OPTIONS_LOG_VERBOSITY, &logVerbosity);
+    void SessionPool::add(const std::shared_ptr<Session> &session)
+    {
+        QMutexLocker locker(&m_mutex);
+        session->lastUsedMsec = QDateTime::currentMSecsSinceEpoch();
+        m_sessions.insert(session->key, session);
+    }
 
-            QFutureWatcher<int> watcher;
-            QFuture<int> future = QtConcurrent::run([this]() {
-                return ssh_connect(m_session);
-            });
+    void SessionPool::release(const std::shared_ptr<Session> &session)
+    {
+        bool connected = false;
+        {
+            QMutexLocker sessionLocker(&session->mutex);
+            connected = !session->failed && ssh_is_connected(session->handle);
+        }
 
-            QEventLoop wait;
-            connect(&watcher, &QFutureWatcher<ErrorCode>::finished, &wait, &QEventLoop::quit);
-            watcher.setFuture(future);
-            wait.exec();
+        QMutexLocker locker(&m_mutex);
+        session->users--;
+        session->lastUsedMsec = QDateTime::currentMSecsSinceEpoch();
+        if (!connected) {
+            m_sessions.remove(session->key, session);
+        }
+    }
 
-            int connectionResult = watcher.result();
+    void SessionPool::remove(const std::shared_ptr<Session> &session)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_sessions.remove(session->key, session);
+    }
 
-            if (connectionResult != SSH_OK) {
-                return fromLibsshErrorCode();
+    void SessionPool::maintain()
+    {
+        QList<std::shared_ptr<Session>> idle;
+        {
+            QMutexLocker locker(&m_mutex);
+            for (const std::shared_ptr<Session> &session : std::as_const(m_sessions)) {
+                if (session->users == 0) {
+                    idle.append(session);
+                }
             }
+        }
 
-            std::string authUsername = credentials.userName.toStdString();
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (const std::shared_ptr<Session> &session : idle) {
+            bool alive = now - session->lastUsedMsec < IDLE_EXPIRY_MSEC;
+            if (alive) {
+                QMutexLocker sessionLocker(&session->mutex);
+                alive = !session->failed && ssh_send_keepalive(session->handle) == SSH_OK
+                        && ssh_is_connected(session->handle);
+            }
 
-            int authResult = SSH_ERROR;
-            if (credentials.secretData.contains("BEGIN") && credentials.secretData.contains("PRIVATE KEY")) {
-                ssh_key privateKey = nullptr;
-                ssh_key publicKey = nullptr;
-                authResult = ssh_pki_import_privkey_base64(credentials.secretData.toStdString().c_str(), nullptr, callback, nullptr, &privateKey);
-                if (authResult == SSH_OK) {
-                    authResult = ssh_pki_export_privkey_to_pubkey(privateKey, &publicKey);
+            if (!alive) {
+                // Closed when the last client holding it lets go
+                QMutexLocker locker(&m_mutex);
+                if (session->users == 0) {
+                    m_sessions.remove(session->key, session);
                 }
+            }
+        }
+    }
 
-                if (authResult == SSH_OK) {
-                    authResult = ssh_userauth_try_publickey(m_session, authUsername.c_str(), publicKey);
-                }
+    Client::~Client()
+    {
+        disconnectFromHost();
+    }
 
-                if (authResult == SSH_OK) {
-                    authResult = ssh_userauth_publickey(m_session, authUsername.c_str(), privateKey);
-                }
+    ErrorCode Client::connectToHost(const ServerCredentials &credentials)
+    {
+        const QByteArray key = SessionPool::key(credentials);
 
-                if (publicKey) {
-                    ssh_key_free(publicKey);
-                }
-                if (privateKey) {
-                    ssh_key_free(privateKey);
-                }
-                if (authResult != SSH_OK) {
-                    qCritical() << ssh_get_error(m_session);
-                    ErrorCode errorCode = fromLibsshErrorCode();
-                    if (errorCode == ErrorCode::NoError) {
-                        errorCode = ErrorCode::SshPrivateKeyFormatError;
-                    }
-                    return errorCode;
-                }
-            } else {
-                authResult = ssh_userauth_password(m_session, authUsername.c_str(), credentials.secretData.toStdString().c_str());
-                if (authResult != SSH_OK) {
-                    return fromLibsshErrorCode();
+        if (m_pooledSession) {
+            bool connected = false;
+            {
+                SessionLock lock(m_pooledSession);
+                connected = !m_pooledSession->failed && ssh_is_connected(m_session);
+            }
+            if (connected && m_pooledSession->key == key) {
+                return ErrorCode::NoError;
+            }
+            disconnectFromHost();
+        }
+
+        m_pooledSession = SessionPool::instance()->acquire(key);
+        if (m_pooledSession) {
+            m_session = m_pooledSession->handle;
+            return ErrorCode::NoError;
+        }
+
+        ErrorCode errorCode = openSession(credentials);
+        if (errorCode != ErrorCode::NoError) {
+            if (m_session != nullptr) {
+                ssh_free(m_session);
+                m_session = nullptr;
+            }
+            return errorCode;
+        }
+
+        m_pooledSession = std::make_shared<Session>(m_session, key);
+        m_pooledSession->users = 1;
+        SessionPool::instance()->add(m_pooledSession);
+        return ErrorCode::NoError;
+    }
+
+    ErrorCode Client::openSession(const ServerCredentials &credentials)
+    {
+        m_session = ssh_new();
+
+        if (m_session == nullptr) {
+            qDebug() << "Failed to create ssh session";
+            return ErrorCode::InternalError;
+        }
+
+        int port = credentials.port;
+        int logVerbosity = SSH_LOG_NOLOG;
+        std::string hostIp = credentials.hostName.toStdString();
+        std::string hostUsername = credentials.userName.toStdString() + "@" + hostIp;
+
+        ssh_options_set(m_session, SSH_OPTIONS_HOST, hostIp.c_str());
+        ssh_options_set(m_session, SSH_OPTIONS_PORT, &port);
+        ssh_options_set(m_session, SSH_OPTIONS_USER, hostUsername.c_str());
+        ssh_options_set(m_session, SSH_OPTIONS_LOG_VERBOSITY, &logVerbosity);
+
+        QFutureWatcher<int> watcher;
+        QFuture<int> future = QtConcurrent::run([this]() {
+            return ssh_connect(m_session);
+        });
+
+        QEventLoop wait;
+        connect(&watcher, &QFutureWatcher<ErrorCode>::finished, &wait, &QEventLoop::quit);
+        watcher.setFuture(future);
+        wait.exec();
+
+        int connectionResult = watcher.result();
+
+        if (connectionResult != SSH_OK) {
+            return fromLibsshErrorCode();
+        }
+
+        std::string authUsername = credentials.userName.toStdString();
+
+        int authResult = SSH_ERROR;
+        if (credentials.secretData.contains("BEGIN") && credentials.secretData.contains("PRIVATE KEY")) {
+            ssh_key privateKey = nullptr;
+            ssh_key publicKey = nullptr;
+            authResult = ssh_pki_import_privkey_base64(credentials.secretData.toStdString().c_str(), nullptr, callback, nullptr, &privateKey);
+            if (authResult == SSH_OK) {
+                authResult = ssh_pki_export_privkey_to_pubkey(privateKey, &publicKey);
+            }
+
+            if (authResult == SSH_OK) {
+                authResult = ssh_userauth_try_publickey(m_session, authUsername.c_str(), publicKey);
+            }
+
+            if (authResult == SSH_OK) {
+                authResult = ssh_userauth_publickey(m_session, authUsername.c_str(), privateKey);
+            }
+
+            if (publicKey) {
+                ssh_key_free(publicKey);
+            }
+            if (privateKey) {
+                ssh_key_free(privateKey);
+            }
+            if (authResult != SSH_OK) {
+                qCritical() << ssh_get_error(m_session);
+                ErrorCode errorCode = fromLibsshErrorCode();
+                if (errorCode == ErrorCode::NoError) {
+                    errorCode = ErrorCode::SshPrivateKeyFormatError;
                 }
+                return errorCode;
+            }
+        } else {
+            authResult = ssh_userauth_password(m_session, authUsername.c_str(), credentials.secretData.toStdString().c_str());
+            if (authResult != SSH_OK) {
+                return fromLibsshErrorCode();
             }
         }
         return ErrorCode::NoError;
@@ -109,81 +295,230 @@ namespace libssh {
 
     void Client::disconnectFromHost()
     {
-        if (m_session != nullptr) {
-            if (ssh_is_connected(m_session)) {
-                ssh_disconnect(m_session);
-            }
-            ssh_free(m_session);
-            m_session = nullptr;
+        // The session stays open in the pool for the next operation on this server
+        closeChannel();
+        closeScpSession();
+        if (m_pooledSession) {
+            SessionPool::instance()->release(m_pooledSession);
+            m_pooledSession.reset();
         }
+        m_session = nullptr;
     }
 
     ErrorCode Client::executeCommand(const QString &data,
                                         const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
                                         const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr)
     {
-        m_channel = ssh_channel_new(m_session);
+        // Output is assembled into lines for every stream separately. An unfinished line is
+        // passed on at the end or once the channel stays quiet for promptIdleMsec, interactive
+        // prompts do not end with a newline.
+        QByteArray pending[2];
+        const std::function<ErrorCode (const QString &, Client &)> *callbacks[2] = { &cbReadStdOut, &cbReadStdErr };
+
+        auto deliver = [this, &callbacks](int stream, const char *line, qsizetype size) {
+            const auto &callback = *callbacks[stream];
+            if (!callback) {
+                return ErrorCode::NoError;
+            }
+            return callback(QString::fromUtf8(line, size), *this);
+        };
+
+        auto onChunk = [&](const QByteArray &chunk, bool isStdErr) {
+            QByteArray &buffer = pending[isStdErr];
+            buffer.append(chunk);
+
+            qsizetype start = 0;
+            qsizetype newline;
+            ErrorCode error = ErrorCode::NoError;
+            while (error == ErrorCode::NoError && (newline = buffer.indexOf('\n', start)) >= 0) {
+                error = deliver(isStdErr, buffer.constData() + start, newline - start);
+                start = newline + 1;
+            }
+            buffer.remove(0, start);
+            return error;
+        };
+
+        auto onIdle = [&]() {
+            for (int stream = 0; stream < 2; ++stream) {
+                if (!pending[stream].isEmpty()) {
+                    const QByteArray line = std::exchange(pending[stream], QByteArray());
+                    ErrorCode error = deliver(stream, line.constData(), line.size());
+                    if (error != ErrorCode::NoError) {
+                        return error;
+                    }
+                }
+            }
+            return ErrorCode::NoError;
+        };
+
+        return runCommand(data, onChunk, onIdle);
+    }
+
+    ErrorCode Client::executeCommandBytes(const QString &data,
+                                          const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdOut,
+                                          const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdErr)
+    {
+        auto onChunk = [&](const QByteArray &chunk, bool isStdErr) {
+            const auto &callback = isStdErr ? cbReadStdErr : cbReadStdOut;
+            return callback ? callback(chunk, *this) : ErrorCode::NoError;
+        };
+        return runCommand(data, onChunk, nullptr);
+    }
 
-        if (m_channel == nullptr) {
-            return closeChannel();
+    ErrorCode Client::executeCommandWithInput(const QString &data, const QByteArray &input,
+                                              const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdOut,
+                                              const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdErr)
+    {
+        auto onChunk = [&](const QByteArray &chunk, bool isStdErr) {
+            const auto &callback = isStdErr ? cbReadStdErr : cbReadStdOut;
+            return callback ? callback(chunk, *this) : ErrorCode::NoError;
+        };
+        return runCommand(data, onChunk, nullptr, &input);
+    }
+
+    ErrorCode Client::runCommand(const QString &data,
+                                 const std::function<ErrorCode (const QByteArray &, bool)> &onChunk,
+                                 const std::function<ErrorCode ()> &onIdle,
+                                 const QByteArray *input)
+    {
+        if (!m_pooledSession) {
+            qCritical() << "ssh session not initialized";
+            return ErrorCode::SshInternalError;
+        }
+        if (m_aborted) {
+            return ErrorCode::SshInterruptedError;
         }
 
-        int result = ssh_channel_open_session(m_channel);
+        {
+            SessionLock lock(m_pooledSession);
+            m_channel = ssh_channel_new(m_session);
 
-        if (result == SSH_OK && ssh_channel_is_open(m_channel)) {
-            qDebug() << "SSH chanel opened";
-        } else {
-            return closeChannel();
+            if (m_channel == nullptr) {
+                return failChannel();
+            }
+
+            int result = ssh_channel_open_session(m_channel);
+
+            if (result == SSH_OK && ssh_channel_is_open(m_channel)) {
+                qDebug() << "SSH chanel opened";
+            } else {
+                return failChannel();
+            }
         }
 
         QFutureWatcher<ErrorCode> watcher;
         connect(&watcher, &QFutureWatcher<ErrorCode>::finished, this, &Client::writeToChannelFinished);
 
-        QFuture<ErrorCode> future = QtConcurrent::run([this, &data, &cbReadStdOut, &cbReadStdErr]() {
-            const size_t bufferSize = 2048;
-
-            int bytesRead = 0;
-            char buffer[bufferSize];
-
-            int result = ssh_channel_request_exec(m_channel, data.toUtf8());
-            if (result == SSH_OK) {
-                std::string output;
-                auto readOutput = [&](bool isStdErr) {
-                    bytesRead = ssh_channel_read(m_channel, buffer, sizeof(buffer), isStdErr);
-                    while (bytesRead > 0)
-                    {
-                        output = std::string(buffer, bytesRead);
-                        if (!output.empty()) {
-                            if (cbReadStdOut && !isStdErr){
-                                auto error = cbReadStdOut(output.c_str(), *this);
-                                if (error != ErrorCode::NoError) {
-                                    return error;
-                                }
+        QFuture<ErrorCode> future = QtConcurrent::run([this, &data, &onChunk, &onIdle, input]() {
+            int result;
+            {
+                SessionLock lock(m_pooledSession);
+                result = ssh_channel_request_exec(m_channel, data.toUtf8());
+            }
+            if (result != SSH_OK) {
+                return failChannel();
+            }
+
+            // Both streams are read as data arrives, so a chatty stderr can not fill the
+            // window while stdout is waited for. The buffer grows while reads fill it up.
+            QByteArray buffer(minReadBufferSize, Qt::Uninitialized);
+            bool idleReported = true;
+            QElapsedTimer sinceData;
+            sinceData.start();
+
+            // Input is written in pieces that fit the channel window, between the reads,
+            // so the command output never waits for the whole input to be sent
+            qsizetype written = 0;
+            bool inputDone = input == nullptr;
+            bool failed = false;
+
+            for (;;) {
+                if (m_aborted) {
+                    closeChannel();
+                    return ErrorCode::SshInterruptedError;
+                }
+
+                QByteArray chunks[2];
+                bool finished = false;
+                {
+                    // Other clients may run channels on the same session, so the session
+                    // is locked only for one short wait at a time
+                    SessionLock lock(m_pooledSession);
+
+                    bool canWrite = false;
+                    if (!inputDone) {
+                        const qsizetype size = qMin<qsizetype>(qMin<qsizetype>(input->size() - written, maxWriteChunkSize),
+                                                               ssh_channel_window_size(m_channel));
+                        if (size > 0) {
+                            const int bytesWritten = ssh_channel_write(m_channel, input->constData() + written, size);
+                            if (bytesWritten == SSH_ERROR) {
+                                failed = true;
+                                break;
                             }
-                            if (cbReadStdErr && isStdErr){
-                                auto error = cbReadStdErr(output.c_str(), *this);
-                                if (error != ErrorCode::NoError) {
-                                    return error;
-                                }
+                            written += bytesWritten;
+                        }
+                        if (written == input->size()) {
+                            ssh_channel_send_eof(m_channel);
+                            inputDone = true;
+                        } else {
+                            canWrite = ssh_channel_window_size(m_channel) > 0;
+                        }
+                    }
+
+                    ssh_channel channels[2] = { m_channel, nullptr };
+                    ssh_channel readable[2] = { nullptr, nullptr };
+                    timeval timeout { 0, canWrite ? 0 : readTimeoutMsec * 1000 };
+                    if (ssh_channel_select(channels, readable, nullptr, &timeout) == SSH_ERROR) {
+                        failed = true;
+                        break;
+                    }
+
+                    for (int stream = 0; stream < 2; ++stream) {
+                        const int bytesRead = ssh_channel_read_nonblocking(m_channel, buffer.data(), buffer.size(), stream);
+                        if (bytesRead > 0) {
+                            chunks[stream] = QByteArray(buffer.constData(), bytesRead);
+                            if (bytesRead == buffer.size() && buffer.size() < maxReadBufferSize) {
+                                buffer.resize(buffer.size() * 2);
                             }
+                        } else if (bytesRead == SSH_ERROR) {
+                            finished = true;
+                        }
+                    }
+
+                    finished = finished || !ssh_channel_is_open(m_channel)
+                            || (ssh_channel_is_eof(m_channel) && ssh_channel_poll(m_channel, 0) <= 0
+                                && ssh_channel_poll(m_channel, 1) <= 0);
+                }
+
+                const bool hasData = !chunks[0].isEmpty() || !chunks[1].isEmpty();
+                for (int stream = 0; stream < 2; ++stream) {
+                    if (!chunks[stream].isEmpty()) {
+                        ErrorCode error = onChunk(chunks[stream], stream);
+                        if (error != ErrorCode::NoError) {
+                            closeChannel();
+                            return error;
                         }
-                        bytesRead = ssh_channel_read(m_channel, buffer, sizeof(buffer), isStdErr);
                     }
-                    return ErrorCode::NoError;
-                };
+                }
 
-                auto errorCode = readOutput(false);
-                if (errorCode != ErrorCode::NoError) {
-                    return errorCode;
+                if (hasData) {
+                    sinceData.restart();
+                    idleReported = false;
                 }
-                errorCode = readOutput(true);
-                if (errorCode != ErrorCode::NoError) {
-                    return errorCode;
+                if ((finished || (!idleReported && sinceData.elapsed() >= promptIdleMsec)) && onIdle) {
+                    ErrorCode error = onIdle();
+                    if (error != ErrorCode::NoError) {
+                        closeChannel();
+                        return error;
+                    }
+                    idleReported = true;
+                }
+
+                if (finished) {
+                    break;
                 }
-            } else {
-                return closeChannel();
             }
-            return closeChannel();
+            return failed ? failChannel() : closeChannel();
         });
         watcher.setFuture(future);
 
@@ -194,6 +529,16 @@ namespace libssh {
         return watcher.result();
     }
 
+    void Client::abort()
+    {
+        m_aborted = true;
+    }
+
+    void Client::resetAbort()
+    {
+        m_aborted = false;
+    }
+
     ErrorCode Client::writeResponse(const QString &data)
     {
         if (m_channel == nullptr) {
@@ -201,45 +546,63 @@ namespace libssh {
             return fromLibsshErrorCode();
         }
 
+        SessionLock lock(m_pooledSession);
         int bytesWritten = ssh_channel_write(m_channel, data.toUtf8(), (uint32_t)data.size());
-        if (bytesWritten == data.size() && ssh_channel_write(m_channel, "\n", 1)) {
+        if (bytesWritten != data.size() || ssh_channel_write(m_channel, "\n", 1) != 1) {
             return fromLibsshErrorCode();
         }
-        return fromLibsshErrorCode();
+        return ErrorCode::NoError;
     }
 
     ErrorCode Client::closeChannel()
     {
+        SessionLock lock(m_pooledSession);
+        int result = SSH_OK;
         if (m_channel != nullptr) {
             if (ssh_channel_is_eof(m_channel)) {
                 ssh_channel_send_eof(m_channel);
             }
             if (ssh_channel_is_open(m_channel)) {
-                ssh_channel_close(m_channel);
+                result = ssh_channel_close(m_channel);
             }
             ssh_channel_free(m_channel);
             m_channel = nullptr;
         }
-        return fromLibsshErrorCode();
+        return result == SSH_OK ? ErrorCode::NoError : fromLibsshErrorCode();
+    }
+
+    ErrorCode Client::failChannel()
+    {
+        ErrorCode errorCode = fromLibsshErrorCode();
+        if (errorCode == ErrorCode::NoError) {
+            errorCode = ErrorCode::SshInternalError;
+        }
+        closeChannel();
+        return errorCode;
     }
 
     ErrorCode Client::scpFileCopy(const ScpOverwriteMode overwriteMode, const QString& localPath, const QString& remotePath, const QString &fileDesc)
     {
-        m_scpSession = ssh_scp_new(m_session, SSH_SCP_WRITE, remotePath.toStdString().c_str());
+        {
+            SessionLock lock(m_pooledSession);
+            m_scpSession = ssh_scp_new(m_session, SSH_SCP_WRITE, remotePath.toStdString().c_str());
 
-        if (m_scpSession == nullptr) {
-            return fromLibsshErrorCode();
-        }
+            if (m_scpSession == nullptr) {
+                return fromLibsshErrorCode();
+            }
 
-        if (ssh_scp_init(m_scpSession) != SSH_OK) {
-            auto errorCode = fromLibsshErrorCode();
-            closeScpSession();
-            return errorCode;
+            if (ssh_scp_init(m_scpSession) != SSH_OK) {
+                auto errorCode = fromLibsshErrorCode();
+                closeScpSession();
+                return errorCode;
+            }
         }
 
         QFutureWatcher<ErrorCode> watcher;
         connect(&watcher, &QFutureWatcher<ErrorCode>::finished, this, &Client::scpFileCopyFinished);
         QFuture<ErrorCode> future = QtConcurrent::run([this, overwriteMode, &localPath, &remotePath, &fileDesc]() {
+            // The transfer holds the session, channels of other clients wait for it
+            SessionLock lock(m_pooledSession);
             const int accessType = O_WRONLY | O_CREAT | overwriteMode;
             const int localFileSize = QFileInfo(localPath).size();
 
@@ -292,6 +655,7 @@ namespace libssh {
 
     void Client::closeScpSession()
     {
+        SessionLock lock(m_pooledSession);
         if (m_scpSession != nullptr) {
             ssh_scp_free(m_scpSession);
             m_scpSession = nullptr;
@@ -300,8 +664,15 @@ namespace libssh {
 
     ErrorCode Client::fromLibsshErrorCode()
     {
+        // The error code belongs to the whole session and stays set until the next failure
+        // overwrites it, so it is read only after a call has failed. A session that reported
+        // an error is not handed out again, later clients would otherwise see this error.
+        SessionLock lock(m_pooledSession);
         int errorCode = ssh_get_error_code(m_session);
         if (errorCode != SSH_NO_ERROR) {
+            if (m_pooledSession) {
+                m_pooledSession->failed = true;
+            }
             QString errorMessage = ssh_get_error(m_session);
             qCritical() << errorMessage;
             if (errorMessage.contains(libsshTimeoutError)) {
@@ -3,8 +3,14 @@
 
 #include <QObject>
 #include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QRecursiveMutex>
+#include <QTimer>
 
+#include <atomic>
 #include <fcntl.h>
+#include <memory>
 
 #include <libssh/libssh.h>
 
@@ -19,34 +25,106 @@ namespace libssh {
         /*! Append new content if the file already exists */
         ScpAppendToExisting = O_APPEND
     };
+
+    // Authenticated connection shared by the clients of one server. libssh sessions are
+    // not thread safe, every libssh call on the session or its channels holds the mutex.
+    struct Session
+    {
+        explicit Session(ssh_session handle, const QByteArray &key) : handle(handle), key(key) {}
+        ~Session();
+
+        ssh_session handle;
+        QByteArray key;
+        QRecursiveMutex mutex;
+        int users = 0; // clients holding the session, each with its own channel
+        qint64 lastUsedMsec = 0;
+        bool failed = false; // reported an error, the pool drops it once its clients let go
+    };
+
+    /**
+     * @brief The SessionPool class - Keeps SSH sessions open between operations
+     *
+     * Sessions are keyed by the server credentials. A session is shared by up to
+     * MAX_CHANNELS clients at a time, each running its own channel. Idle sessions
+     * get a keepalive every KEEPALIVE_INTERVAL_MSEC and are closed after
+     * IDLE_EXPIRY_MSEC without use.
+     */
+    class SessionPool : public QObject
+    {
+        Q_OBJECT
+    public:
+        static constexpr int MAX_CHANNELS = 4;
+        static constexpr int KEEPALIVE_INTERVAL_MSEC = 30 * 1000;
+        static constexpr int IDLE_EXPIRY_MSEC = 5 * 60 * 1000;
+
+        static SessionPool *instance();
+
+        static QByteArray key(const ServerCredentials &credentials);
+
+        // Connected session with a free channel, nullptr if there is none
+        std::shared_ptr<Session> acquire(const QByteArray &key);
+        void add(const std::shared_ptr<Session> &session);
+        void release(const std::shared_ptr<Session> &session);
+        void remove(const std::shared_ptr<Session> &session);
+
+    private:
+        SessionPool();
+        void maintain();
+
+        QMutex m_mutex;
+        QMultiHash<QByteArray, std::shared_ptr<Session>> m_sessions;
+        QTimer *m_timer = nullptr;
+    };
+
     class Client : public QObject
     {
         Q_OBJECT
     public:
         Client() = default;
-        ~Client() = default;
+        ~Client();
 
         ErrorCode connectToHost(const ServerCredentials &credentials);
         void disconnectFromHost();
+        // Callbacks get the output line by line, without the line break
         ErrorCode executeCommand(const QString &data,
                                  const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
                                  const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr);
+        // Callbacks get the raw output chunks as they arrive
+        ErrorCode executeCommandBytes(const QString &data,
+                                      const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdOut,
+                                      const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdErr);
+        // Streams input to the command stdin and closes it, callbacks as in executeCommandBytes
+        ErrorCode executeCommandWithInput(const QString &data, const QByteArray &input,
+                                          const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdOut,
+                                          const std::function<ErrorCode (const QByteArray &, Client &)> &cbReadStdErr);
         ErrorCode writeResponse(const QString &data);
         ErrorCode scpFileCopy(const ScpOverwriteMode overwriteMode,
                                const QString &localPath,
                                const QString &remotePath,
                                const QString &fileDesc);
         ErrorCode getDecryptedPrivateKey(const ServerCredentials &credentials, QString &decryptedPrivateKey, const std::function<QString()> &passphraseCallback);
+        // Thread safe. The running command ends with SshInterruptedError within one read
+        // timeout, later commands are refused until resetAbort().
+        void abort();
+        void resetAbort();
     private:
+        ErrorCode openSession(const ServerCredentials &credentials);
+        ErrorCode runCommand(const QString &data,
+                             const std::function<ErrorCode (const QByteArray &, bool)> &onChunk,
+                             const std::function<ErrorCode ()> &onIdle,
+                             const QByteArray *input = nullptr);
         ErrorCode closeChannel();
+        ErrorCode failChannel();
         void closeScpSession();
         ErrorCode fromLibsshErrorCode();
         ErrorCode fromFileErrorCode(QFileDevice::FileError fileError);
         static int callback(const char *prompt, char *buf, size_t len, int echo, int verify, void *userdata);
 
-        ssh_session m_session = nullptr;
+        std::shared_ptr<Session> m_pooledSession;
+        ssh_session m_session = nullptr; // handle of m_pooledSession
         ssh_channel m_channel = nullptr;
         ssh_scp m_scpSession = nullptr;
+        std::atomic<bool> m_aborted { false };
 
         static std::function<QString()> m_passphraseCallback;
     signals:
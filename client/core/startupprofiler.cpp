@@ -0,0 +1,165 @@
+#include "startupprofiler.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QThread>
+
+namespace
+{
+    constexpr char startupTraceEnv[] = "AMNEZIA_STARTUP_TRACE";
+    constexpr char defaultTraceFileName[] = "startup_trace.json";
+}
+
+StartupProfiler::Scope::Scope(const char *phase)
+    : m_phase(phase), m_startUsec(StartupProfiler::instance()->isEnabled() ? StartupProfiler::instance()->elapsedUsec() : -1)
+{
+}
+
+StartupProfiler::Scope::~Scope()
+{
+    if (m_startUsec >= 0) {
+        StartupProfiler *profiler = StartupProfiler::instance();
+        profiler->record(m_phase, m_startUsec, profiler->elapsedUsec() - m_startUsec);
+    }
+}
+
+StartupProfiler *StartupProfiler::instance()
+{
+    static StartupProfiler *profiler = new StartupProfiler();
+    return profiler;
+}
+
+StartupProfiler::StartupProfiler()
+{
+    m_clock.start();
+
+    const QString path = qEnvironmentVariable(startupTraceEnv);
+    m_enabled = !path.isEmpty() && path != "0";
+    if (path != "1") {
+        m_path = path;
+    }
+}
+
+qint64 StartupProfiler::elapsedUsec() const
+{
+    return m_clock.nsecsElapsed() / 1000;
+}
+
+void StartupProfiler::record(const char *phase, qint64 startUsec, qint64 durationUsec)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_finished) {
+        m_events.append({ QByteArray(phase), startUsec, durationUsec, reinterpret_cast<quintptr>(QThread::currentThreadId()) });
+    }
+}
+
+void StartupProfiler::mark(const char *event)
+{
+    record(event, elapsedUsec(), -1);
+}
+
+void StartupProfiler::finish()
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    mark("startup finished");
+
+    QByteArray trace;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_finished) {
+            return;
+        }
+        m_finished = true;
+        trace = toTrace();
+    }
+
+    // The default location is resolved here, the application name is not set
+    // yet when the first phases are recorded
+    QString path = m_path;
+    if (path.isEmpty()) {
+        const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+        QDir().mkpath(dir);
+        path = QDir(dir).filePath(defaultTraceFileName);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(trace) != trace.size() || !file.commit()) {
+        qWarning() << "Unable to write startup trace to" << path << file.errorString();
+        return;
+    }
+
+    qInfo().noquote() << report();
+    qInfo() << "Startup trace saved to" << path;
+}
+
+QByteArray StartupProfiler::toTrace() const
+{
+    QJsonArray events;
+    const qint64 pid = QCoreApplication::applicationPid();
+    for (const Event &event : m_events) {
+        QJsonObject e;
+        e.insert("name", QString::fromUtf8(event.name));
+        e.insert("cat", "startup");
+        e.insert("pid", pid);
+        e.insert("tid", static_cast<qint64>(event.thread));
+        e.insert("ts", event.startUsec);
+        if (event.durationUsec < 0) {
+            e.insert("ph", "i");
+            e.insert("s", "g");
+        } else {
+            e.insert("ph", "X");
+            e.insert("dur", event.durationUsec);
+        }
+        events.append(e);
+    }
+
+    QJsonObject trace;
+    trace.insert("traceEvents", events);
+    trace.insert("displayTimeUnit", "ms");
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+QString StartupProfiler::report() const
+{
+    // Phases repeated during the start (like decryption of every value) are summed up
+    QMutexLocker locker(&m_mutex);
+    QVector<QByteArray> order;
+    QHash<QByteArray, QPair<int, qint64>> totals;
+    for (const Event &event : m_events) {
+        if (event.durationUsec < 0) {
+            continue;
+        }
+        if (!totals.contains(event.name)) {
+            order.append(event.name);
+        }
+        QPair<int, qint64> &total = totals[event.name];
+        total.first++;
+        total.second += event.durationUsec;
+    }
+
+    QStringList lines { QString("Startup timeline, %1 ms total:").arg(m_events.isEmpty() ? 0 : m_events.last().startUsec / 1000) };
+    for (const QByteArray &name : order) {
+        const QPair<int, qint64> &total = totals.value(name);
+        lines.append(QString("  %1: %2 ms%3")
+                             .arg(QString::fromUtf8(name))
+                             .arg(total.second / 1000.0, 0, 'f', 1)
+                             .arg(total.first > 1 ? QString(" in %1 calls").arg(total.first) : QString()));
+    }
+    return lines.join('\n');
+}
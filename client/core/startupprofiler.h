@@ -0,0 +1,62 @@
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+// Records the phases of the application start (settings load, keychain, decryption,
+// model construction, QML load) as a timeline. When AMNEZIA_STARTUP_TRACE is set,
+// finish() writes it in the Chrome trace event format, which chrome://tracing and
+// Perfetto can open. The variable holds the file path, "1" selects the app data location.
+class StartupProfiler
+{
+public:
+    class Scope
+    {
+    public:
+        explicit Scope(const char *phase);
+        ~Scope();
+
+    private:
+        const char *m_phase;
+        qint64 m_startUsec;
+    };
+
+    static StartupProfiler *instance();
+
+    bool isEnabled() const { return m_enabled; }
+    qint64 elapsedUsec() const;
+
+    void record(const char *phase, qint64 startUsec, qint64 durationUsec);
+    void mark(const char *event);
+
+    // Writes the trace once, later events are ignored
+    void finish();
+
+private:
+    StartupProfiler();
+
+    struct Event
+    {
+        QByteArray name;
+        qint64 startUsec = 0;
+        qint64 durationUsec = -1; // -1 for instant events
+        quintptr thread = 0;
+    };
+
+    QByteArray toTrace() const;
+    QString report() const;
+
+    QElapsedTimer m_clock;
+    bool m_enabled = false;
+    QString m_path;
+
+    mutable QMutex m_mutex;
+    bool m_finished = false;
+    QVector<Event> m_events;
+};
+
+#endif // STARTUPPROFILER_H
@@ -18,6 +18,12 @@
 constexpr const char* JSON_ALLOWEDIPADDRESSRANGES = "allowedIPAddressRanges";
 constexpr int HANDSHAKE_POLL_MSEC = 250;
 
+// While a status subscriber is registered, peer statistics are sampled at
+// this interval into a ring buffer of PEER_HISTORY_SIZE entries, so status
+// replies carry the last minute. Otherwise only status requests add samples.
+constexpr int PEER_STATS_POLL_MSEC = 1000;
+constexpr int PEER_HISTORY_SIZE = 60;
+
 namespace {
 
 Logger logger("Daemon");
@@ -36,6 +42,9 @@ Daemon::Daemon(QObject* parent) : QObject(parent) {
 
   m_handshakeTimer.setSingleShot(true);
   connect(&m_handshakeTimer, &QTimer::timeout, this, &Daemon::checkHandshake);
+
+  m_statsTimer.setInterval(PEER_STATS_POLL_MSEC);
+  connect(&m_statsTimer, &QTimer::timeout, this, &Daemon::samplePeerStatus);
 }
 
 Daemon::~Daemon() {
@@ -91,6 +100,8 @@ bool Daemon::activate(const InterfaceConfig& config) {
       if (status) {
         m_connections[config.m_hopType] = ConnectionState(config);
         m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
+        prunePeerHistory();
+        updateStatsTimer();
         emit_failure_guard.dismiss();
         return true;
       }
@@ -121,9 +132,7 @@ bool Daemon::activate(const InterfaceConfig& config) {
   }
 
   // Configure routing for excluded addresses.
-  for (const QString& i : config.m_excludedAddresses) {
-    addExclusionRoute(IPAddress(i));
-  }
+  addExclusionRoutes(config.m_excludedAddresses);
 
   // Add the peer to this interface.
   if (!wgutils()->updatePeer(config)) {
@@ -145,12 +154,10 @@ bool Daemon::activate(const InterfaceConfig& config) {
   }
 
   // set routing
-  for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
-    if (!wgutils()->updateRoutePrefix(ip)) {
-      logger.debug() << "Routing configuration failed for"
-                     << logger.sensitive(ip.toString());
-      return false;
-    }
+  if (!wgutils()->updateRoutePrefixes(config.m_allowedIPAddressRanges)) {
+    logger.debug() << "Routing configuration failed for"
+                   << config.m_allowedIPAddressRanges.size() << "prefixes";
+    return false;
   }
 
   bool status = run(Up, config);
@@ -158,6 +165,7 @@ bool Daemon::activate(const InterfaceConfig& config) {
   if (status) {
     m_connections[config.m_hopType] = ConnectionState(config);
     m_handshakeTimer.start(HANDSHAKE_POLL_MSEC);
+    updateStatsTimer();
     emit_failure_guard.dismiss();
     return true;
   }
@@ -217,6 +225,17 @@ bool Daemon::addExclusionRoute(const IPAddress& prefix) {
   return true;
 }
 
+// Best effort, a failed exclusion route does not stop the connection.
+void Daemon::addExclusionRoutes(const QStringList& addresses) {
+  for (const QString& i : addresses) {
+    IPAddress prefix(i);
+    if (!addExclusionRoute(prefix)) {
+      logger.warning() << "Exclusion route failed for"
+                       << logger.sensitive(prefix.toString());
+    }
+  }
+}
+
 bool Daemon::delExclusionRoute(const IPAddress& prefix) {
   Q_ASSERT(m_excludedAddrSet.contains(prefix));
   if (m_excludedAddrSet[prefix] > 1) {
@@ -427,9 +446,7 @@ bool Daemon::deactivate(bool emitSignals) {
   for (const ConnectionState& state : m_connections) {
     const InterfaceConfig& config = state.m_config;
     logger.debug() << "Deleting routes for" << config.m_hopType;
-    for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
-      wgutils()->deleteRoutePrefix(ip);
-    }
+    wgutils()->deleteRoutePrefixes(config.m_allowedIPAddressRanges);
     wgutils()->deletePeer(config);
   }
 
@@ -441,6 +458,8 @@ bool Daemon::deactivate(bool emitSignals) {
   m_excludedAddrSet.clear();
 
   m_connections.clear();
+  m_statsTimer.stop();
+  m_peerHistory.clear();
   // Delete the interface
   return wgutils()->deleteInterface();  
 }
@@ -475,31 +494,32 @@ bool Daemon::switchServer(const InterfaceConfig& config) {
       m_connections.value(config.m_hopType).m_config;
 
   // Configure routing for new excluded addresses.
-  for (const QString& i : config.m_excludedAddresses) {
-    addExclusionRoute(IPAddress(i));
-  }
+  addExclusionRoutes(config.m_excludedAddresses);
 
   // Activate the new peer and its routes.
   if (!wgutils()->updatePeer(config)) {
     logger.error() << "Server switch failed to update the wireguard interface";
     return false;
   }
-  for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
-    if (!wgutils()->updateRoutePrefix(ip)) {
-      logger.error() << "Server switch failed to update the routing table";
-      break;
-    }
+  if (!wgutils()->updateRoutePrefixes(config.m_allowedIPAddressRanges)) {
+    logger.error() << "Server switch failed to update the routing table";
   }
 
-  // Remove routing entries for the old peer.
+  // Remove routing entries for the old peer. Both sets are compared in
+  // their aggregated form, which is what has been installed.
   for (const QString& i : lastConfig.m_excludedAddresses) {
     delExclusionRoute(QHostAddress(i));
   }
-  for (const IPAddress& ip : lastConfig.m_allowedIPAddressRanges) {
-    if (!config.m_allowedIPAddressRanges.contains(ip)) {
-      wgutils()->deleteRoutePrefix(ip);
+  QList<IPAddress> newRoutes =
+      IPAddress::aggregate(config.m_allowedIPAddressRanges);
+  QList<IPAddress> staleRoutes;
+  for (const IPAddress& ip :
+       IPAddress::aggregate(lastConfig.m_allowedIPAddressRanges)) {
+    if (!newRoutes.contains(ip)) {
+      staleRoutes.append(ip);
     }
   }
+  wgutils()->deleteRoutePrefixes(staleRoutes);
 
   // Remove the old peer if it is no longer necessary.
   if (config.m_serverPublicKey != lastConfig.m_serverPublicKey) {
@@ -522,8 +542,26 @@ QJsonObject Daemon::getStatus() {
     return json;
   }
 
-  const ConnectionState& connection = m_connections.first();
   QList<WireguardUtils::PeerStatus> peers = wgutils()->getPeerStatus();
+  recordPeerStatus(peers);
+
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  QMetaEnum hopTypeMeta = QMetaEnum::fromType<InterfaceConfig::HopType>();
+  QJsonArray peerHistory;
+  for (const ConnectionState& state : m_connections) {
+    const QString& pubkey = state.m_config.m_serverPublicKey;
+    auto history = m_peerHistory.constFind(pubkey);
+    if (history == m_peerHistory.constEnd()) {
+      continue;
+    }
+    QJsonObject peer = history->toJson(now);
+    peer.insert("pubkey", pubkey);
+    peer.insert("hopType", QString(hopTypeMeta.valueToKey(
+                               state.m_config.m_hopType)));
+    peerHistory.append(peer);
+  }
+
+  const ConnectionState& connection = m_connections.first();
   for (const WireguardUtils::PeerStatus& status : peers) {
     if (status.m_pubkey != connection.m_config.m_serverPublicKey) {
       continue;
@@ -536,6 +574,7 @@ QJsonObject Daemon::getStatus() {
     json.insert("date", connection.m_date.toString());
     json.insert("txBytes", QJsonValue(status.m_txBytes));
     json.insert("rxBytes", QJsonValue(status.m_rxBytes));
+    json.insert("peers", peerHistory);
     return json;
   }
 
@@ -543,6 +582,179 @@ QJsonObject Daemon::getStatus() {
   return json;
 }
 
+void Daemon::samplePeerStatus() {
+  Q_ASSERT(wgutils() != nullptr);
+
+  if (!wgutils()->interfaceExists() || m_connections.isEmpty()) {
+    m_statsTimer.stop();
+    return;
+  }
+  recordPeerStatus(wgutils()->getPeerStatus());
+  emit peerStatusSampled();
+}
+
+QJsonObject Daemon::sampledStatus() const {
+  QJsonObject json;
+  if (m_connections.isEmpty()) {
+    json.insert("connected", QJsonValue(false));
+    return json;
+  }
+
+  const ConnectionState& connection = m_connections.first();
+  auto history = m_peerHistory.constFind(connection.m_config.m_serverPublicKey);
+  if (history == m_peerHistory.constEnd() || history->isEmpty()) {
+    json.insert("connected", QJsonValue(false));
+    return json;
+  }
+
+  const PeerHistory::Sample& sample = history->last();
+  json.insert("connected", QJsonValue(true));
+  json.insert("serverIpv4Gateway",
+              QJsonValue(connection.m_config.m_serverIpv4Gateway));
+  json.insert("deviceIpv4Address",
+              QJsonValue(connection.m_config.m_deviceIpv4Address));
+  json.insert("date", connection.m_date.toString());
+  json.insert("txBytes", QJsonValue(sample.m_txBytes));
+  json.insert("rxBytes", QJsonValue(sample.m_rxBytes));
+  json.insert("handshake", QJsonValue(sample.m_handshake));
+  return json;
+}
+
+void Daemon::addStatusSubscriber() {
+  m_statusSubscribers++;
+  updateStatsTimer();
+}
+
+void Daemon::removeStatusSubscriber() {
+  Q_ASSERT(m_statusSubscribers > 0);
+  m_statusSubscribers--;
+  updateStatsTimer();
+}
+
+void Daemon::updateStatsTimer() {
+  if (m_statusSubscribers > 0 && !m_connections.isEmpty()) {
+    if (!m_statsTimer.isActive()) {
+      m_statsTimer.start();
+    }
+  } else {
+    m_statsTimer.stop();
+  }
+}
+
+void Daemon::prunePeerHistory() {
+  // A server switch replaces the peer of a hop, its history goes with it.
+  for (auto it = m_peerHistory.begin(); it != m_peerHistory.end();) {
+    if (isConnectedPeer(it.key())) {
+      ++it;
+    } else {
+      it = m_peerHistory.erase(it);
+    }
+  }
+}
+
+bool Daemon::isConnectedPeer(const QString& pubkey) const {
+  for (const ConnectionState& state : m_connections) {
+    if (state.m_config.m_serverPublicKey == pubkey) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Daemon::recordPeerStatus(
+    const QList<WireguardUtils::PeerStatus>& peers) {
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  for (const WireguardUtils::PeerStatus& status : peers) {
+    // A peer removed by a server switch may still be listed for a moment.
+    if (!isConnectedPeer(status.m_pubkey)) {
+      continue;
+    }
+
+    PeerHistory& history = m_peerHistory[status.m_pubkey];
+
+    // Status requests may arrive in between two timer samples, don't let
+    // them crowd out the regular samples of the window.
+    if (!history.isEmpty() &&
+        (now - history.last().m_timestamp) < (PEER_STATS_POLL_MSEC / 2)) {
+      continue;
+    }
+
+    PeerHistory::Sample sample;
+    sample.m_timestamp = now;
+    sample.m_rxBytes = status.m_rxBytes;
+    sample.m_txBytes = status.m_txBytes;
+    sample.m_handshake = status.m_handshake;
+    sample.m_endpoint = status.m_endpoint;
+    history.append(sample);
+  }
+}
+
+void Daemon::PeerHistory::append(const Sample& sample) {
+  if (m_samples.isEmpty()) {
+    m_samples.resize(PEER_HISTORY_SIZE);
+  }
+  m_samples[(m_head + m_count) % PEER_HISTORY_SIZE] = sample;
+  if (m_count < PEER_HISTORY_SIZE) {
+    m_count++;
+  } else {
+    m_head = (m_head + 1) % PEER_HISTORY_SIZE;
+  }
+}
+
+const Daemon::PeerHistory::Sample& Daemon::PeerHistory::at(int index) const {
+  Q_ASSERT(index >= 0 && index < m_count);
+  return m_samples.at((m_head + index) % PEER_HISTORY_SIZE);
+}
+
+QJsonObject Daemon::PeerHistory::toJson(qint64 now) const {
+  QJsonObject json;
+  if (isEmpty()) {
+    return json;
+  }
+
+  const Sample& newest = last();
+  json.insert("endpoint", newest.m_endpoint);
+
+  // Handshake age in seconds, -1 until the first handshake.
+  if (newest.m_handshake > 0) {
+    json.insert("handshakeAge", (now - newest.m_handshake) / 1000.0);
+  } else {
+    json.insert("handshakeAge", -1);
+  }
+
+  // Rates in bytes per second, over the most recent sampling interval.
+  double rxRate = 0;
+  double txRate = 0;
+  if (m_count > 1) {
+    const Sample& previous = at(m_count - 2);
+    qint64 elapsed = newest.m_timestamp - previous.m_timestamp;
+    if (elapsed > 0) {
+      rxRate = (newest.m_rxBytes - previous.m_rxBytes) * 1000.0 / elapsed;
+      txRate = (newest.m_txBytes - previous.m_txBytes) * 1000.0 / elapsed;
+    }
+  }
+  json.insert("rxRate", rxRate);
+  json.insert("txRate", txRate);
+
+  // Each sample is encoded as [timestamp, rxBytes, txBytes, handshake] to
+  // keep the reply compact. The endpoint is only repeated when it changes.
+  QJsonArray samples;
+  QString endpoint;
+  for (int i = 0; i < m_count; ++i) {
+    const Sample& sample = at(i);
+    QJsonArray entry{double(sample.m_timestamp), double(sample.m_rxBytes),
+                     double(sample.m_txBytes), double(sample.m_handshake)};
+    if (sample.m_endpoint != endpoint) {
+      endpoint = sample.m_endpoint;
+      entry.append(endpoint);
+    }
+    samples.append(entry);
+  }
+  json.insert("samples", samples);
+
+  return json;
+}
+
 void Daemon::checkHandshake() {
   Q_ASSERT(wgutils() != nullptr);
 
@@ -555,7 +767,8 @@ void Daemon::checkHandshake() {
     if (connection.m_date.isValid()) {
       continue;
     }
-    logger.debug() << "awaiting" << config.m_serverPublicKey;
+    logger.debug().field("pubkey", config.m_serverPublicKey)
+        << "Awaiting handshake";
 
     // Check if the handshake has completed.
     for (const WireguardUtils::PeerStatus& status : peers) {
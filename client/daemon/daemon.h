@@ -6,7 +6,9 @@
 #define DAEMON_H
 
 #include <QDateTime>
+#include <QHash>
 #include <QTimer>
+#include <QVector>
 
 #include "dnsutils.h"
 #include "interfaceconfig.h"
@@ -33,6 +35,13 @@ class Daemon : public QObject {
   virtual bool activate(const InterfaceConfig& config);
   virtual bool deactivate(bool emitSignals = true);
   virtual QJsonObject getStatus();
+  // Status of the main connection built from the last periodic sample,
+  // without querying the wireguard backend.
+  QJsonObject sampledStatus() const;
+  // The peers are sampled periodically only while a connection is up and
+  // at least one status subscriber is registered.
+  void addStatusSubscriber();
+  void removeStatusSubscriber();
 
   // Callback before any Activating measure is done
   virtual void prepareActivation(const InterfaceConfig& config, int inetAdapterIndex = 0) {
@@ -52,10 +61,13 @@ class Daemon : public QObject {
   void activationFailure();
   void disconnected();
   void backendFailure();
+  // Emitted after each periodic sample of the peer statistics.
+  void peerStatusSampled();
 
  private:
   bool maybeUpdateResolvers(const InterfaceConfig& config);
   bool addExclusionRoute(const IPAddress& address);
+  void addExclusionRoutes(const QStringList& addresses);
   bool delExclusionRoute(const IPAddress& address);
 
  protected:
@@ -75,6 +87,11 @@ class Daemon : public QObject {
                               QStringList& list);
 
   void checkHandshake();
+  void samplePeerStatus();
+  void recordPeerStatus(const QList<WireguardUtils::PeerStatus>& peers);
+  void updateStatsTimer();
+  void prunePeerHistory();
+  bool isConnectedPeer(const QString& pubkey) const;
 
   class ConnectionState {
    public:
@@ -86,6 +103,36 @@ class Daemon : public QObject {
   QMap<InterfaceConfig::HopType, ConnectionState> m_connections;
   QHash<IPAddress, int> m_excludedAddrSet;
   QTimer m_handshakeTimer;
+
+  // Fixed-size ring buffer of the most recent status samples of a peer.
+  class PeerHistory {
+   public:
+    class Sample {
+     public:
+      qint64 m_timestamp = 0;
+      qint64 m_rxBytes = 0;
+      qint64 m_txBytes = 0;
+      qint64 m_handshake = 0;
+      QString m_endpoint;
+    };
+
+    void append(const Sample& sample);
+    bool isEmpty() const { return m_count == 0; }
+    // Samples are indexed from the oldest (0) to the newest (count() - 1).
+    int count() const { return m_count; }
+    const Sample& at(int index) const;
+    const Sample& last() const { return at(m_count - 1); }
+
+    QJsonObject toJson(qint64 now) const;
+
+   private:
+    QVector<Sample> m_samples;
+    int m_head = 0;
+    int m_count = 0;
+  };
+  QHash<QString, PeerHistory> m_peerHistory;
+  QTimer m_statsTimer;
+  int m_statusSubscribers = 0;
 };
 
 #endif  // DAEMON_H
@@ -13,6 +13,11 @@
 #include "leakdetector.h"
 #include "logger.h"
 
+// Defaults for status subscriptions, when the client does not set them.
+constexpr qint64 PUSH_DEFAULT_THRESHOLD = 1;
+constexpr int PUSH_DEFAULT_INTERVAL_MSEC = 1000;
+constexpr int PUSH_MIN_INTERVAL_MSEC = 100;
+
 namespace {
 Logger logger("DaemonLocalServerConnection");
 }
@@ -37,11 +42,21 @@ DaemonLocalServerConnection::DaemonLocalServerConnection(QObject* parent,
           &DaemonLocalServerConnection::disconnected);
   connect(daemon, &Daemon::backendFailure, this,
           &DaemonLocalServerConnection::backendFailure);
+  connect(daemon, &Daemon::peerStatusSampled, this,
+          &DaemonLocalServerConnection::peerStatusSampled);
+
+  m_pushTimer.setSingleShot(true);
+  connect(&m_pushTimer, &QTimer::timeout, this,
+          &DaemonLocalServerConnection::pushStatus);
 }
 
 DaemonLocalServerConnection::~DaemonLocalServerConnection() {
   MZ_COUNT_DTOR(DaemonLocalServerConnection);
 
+  if (m_subscribed) {
+    Daemon::instance()->removeStatusSubscriber();
+  }
+
   logger.debug() << "Connection released";
 }
 
@@ -50,39 +65,15 @@ void DaemonLocalServerConnection::readData() {
 
   Q_ASSERT(m_socket);
 
-  while (true) {
-    int pos = m_buffer.indexOf("\n");
-    if (pos == -1) {
-      QByteArray input = m_socket->readAll();
-      if (input.isEmpty()) {
-        break;
-      }
-      m_buffer.append(input);
-      continue;
-    }
-
-    QByteArray line = m_buffer.left(pos);
-    m_buffer.remove(0, pos + 1);
-
-    QByteArray command(line);
-    command = command.trimmed();
+  m_framer.append(m_socket->readAll());
 
-    if (command.isEmpty()) {
-      continue;
-    }
-
-    parseCommand(command);
+  QJsonObject obj;
+  while (m_framer.takeMessage(obj)) {
+    parseCommand(obj);
   }
 }
 
-void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
-  QJsonDocument json = QJsonDocument::fromJson(data);
-  if (!json.isObject()) {
-    logger.error() << "Invalid input";
-    return;
-  }
-
-  QJsonObject obj = json.object();
+void DaemonLocalServerConnection::parseCommand(const QJsonObject& obj) {
   QJsonValue typeValue = obj.value("type");
   if (!typeValue.isString()) {
     logger.warning() << "No type command. Ignoring request.";
@@ -92,6 +83,22 @@ void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
 
   logger.debug() << "Command received:" << type;
 
+  // The client asks to switch to a more compact framing. The reply is still
+  // sent using the current framing, everything after it uses the new one.
+  if (type == "framing") {
+    MessageFramer::Framing framing;
+    if (!MessageFramer::parseFramingName(obj.value("framing").toString(),
+                                         framing)) {
+      framing = m_framer.writeFraming();
+    }
+    QJsonObject obj;
+    obj.insert("type", "framing");
+    obj.insert("framing", MessageFramer::framingName(framing));
+    write(obj);
+    m_framer.setWriteFraming(framing);
+    return;
+  }
+
   // It is expected that sometimes the client will request backend logs
   // before the first authentication. In these cases we just return empty
   // logs.
@@ -130,6 +137,30 @@ void DaemonLocalServerConnection::parseCommand(const QByteArray& data) {
     return;
   }
 
+  if (type == "subscribe") {
+    if (!m_subscribed) {
+      Daemon::instance()->addStatusSubscriber();
+    }
+    m_subscribed = true;
+    m_pushThreshold = obj.value("threshold").toInteger(PUSH_DEFAULT_THRESHOLD);
+    m_pushInterval = qMax(
+        PUSH_MIN_INTERVAL_MSEC,
+        obj.value("interval").toInt(PUSH_DEFAULT_INTERVAL_MSEC));
+    m_pushedFullStatus = false;
+    logger.debug() << "Status subscription, threshold" << m_pushThreshold
+                   << "interval" << m_pushInterval;
+    return;
+  }
+
+  if (type == "unsubscribe") {
+    if (m_subscribed) {
+      Daemon::instance()->removeStatusSubscriber();
+    }
+    m_subscribed = false;
+    m_pushTimer.stop();
+    return;
+  }
+
   if (type == "logs") {
     QJsonObject obj;
     obj.insert("type", "logs");
@@ -154,6 +185,9 @@ void DaemonLocalServerConnection::connected(const QString& pubkey) {
 }
 
 void DaemonLocalServerConnection::disconnected() {
+  m_pushTimer.stop();
+  m_pushedFullStatus = false;
+
   QJsonObject obj;
   obj.insert("type", "disconnected");
   write(obj);
@@ -165,7 +199,61 @@ void DaemonLocalServerConnection::backendFailure() {
   write(obj);
 }
 
+void DaemonLocalServerConnection::peerStatusSampled() {
+  if (!m_subscribed || m_pushTimer.isActive()) {
+    return;
+  }
+
+  QJsonObject status = Daemon::instance()->sampledStatus();
+  if (!status.value("connected").toBool()) {
+    return;
+  }
+
+  if (m_pushedFullStatus) {
+    qint64 traffic =
+        qAbs(status.value("txBytes").toInteger() - m_pushedTxBytes) +
+        qAbs(status.value("rxBytes").toInteger() - m_pushedRxBytes);
+    bool handshake =
+        status.value("handshake").toInteger() != m_pushedHandshake;
+    if (!handshake && traffic < m_pushThreshold) {
+      return;
+    }
+  }
+
+  if (m_lastPush.isValid() && m_lastPush.elapsed() < m_pushInterval) {
+    m_pushTimer.start(m_pushInterval - m_lastPush.elapsed());
+    return;
+  }
+  pushStatus();
+}
+
+void DaemonLocalServerConnection::pushStatus() {
+  QJsonObject status = Daemon::instance()->sampledStatus();
+  if (!m_subscribed || !status.value("connected").toBool()) {
+    return;
+  }
+
+  m_pushedTxBytes = status.value("txBytes").toInteger();
+  m_pushedRxBytes = status.value("rxBytes").toInteger();
+  m_pushedHandshake = status.value("handshake").toInteger();
+  m_lastPush.start();
+
+  // The first push carries the full status, later ones only the counters.
+  if (!m_pushedFullStatus) {
+    m_pushedFullStatus = true;
+    status.insert("type", "status");
+    write(status);
+    return;
+  }
+
+  QJsonObject obj;
+  obj.insert("type", "statusDelta");
+  obj.insert("txBytes", QJsonValue(m_pushedTxBytes));
+  obj.insert("rxBytes", QJsonValue(m_pushedRxBytes));
+  obj.insert("handshake", QJsonValue(m_pushedHandshake));
+  write(obj);
+}
+
 void DaemonLocalServerConnection::write(const QJsonObject& obj) {
-  m_socket->write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
-  m_socket->write("\n");
+  m_socket->write(m_framer.encode(obj));
 }
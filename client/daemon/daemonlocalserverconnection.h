@@ -5,7 +5,11 @@
 #ifndef DAEMONLOCALSERVERCONNECTION_H
 #define DAEMONLOCALSERVERCONNECTION_H
 
+#include <QElapsedTimer>
 #include <QObject>
+#include <QTimer>
+
+#include "messageframer.h"
 
 class QLocalSocket;
 
@@ -19,18 +23,34 @@ class DaemonLocalServerConnection final : public QObject {
  private:
   void readData();
 
-  void parseCommand(const QByteArray& json);
+  void parseCommand(const QJsonObject& obj);
 
   void connected(const QString& pubkey);
   void disconnected();
   void backendFailure();
 
+  void peerStatusSampled();
+  void pushStatus();
+
   void write(const QJsonObject& obj);
 
  private:
   QLocalSocket* m_socket = nullptr;
 
-  QByteArray m_buffer;
+  MessageFramer m_framer;
+
+  // Status subscription: pushes are sent when the traffic counters moved by
+  // at least m_pushThreshold bytes or a handshake happened, and never more
+  // often than once per m_pushInterval msecs.
+  bool m_subscribed = false;
+  qint64 m_pushThreshold = 0;
+  int m_pushInterval = 0;
+  bool m_pushedFullStatus = false;
+  qint64 m_pushedTxBytes = 0;
+  qint64 m_pushedRxBytes = 0;
+  qint64 m_pushedHandshake = 0;
+  QElapsedTimer m_lastPush;
+  QTimer m_pushTimer;
 };
 
 #endif  // DAEMONLOCALSERVERCONNECTION_H
@@ -29,6 +29,7 @@ class WireguardUtils : public QObject {
     qint64 m_handshake = 0;
     qint64 m_rxBytes = 0;
     qint64 m_txBytes = 0;
+    QString m_endpoint;
   };
 
   explicit WireguardUtils(QObject* parent) : QObject(parent){};
@@ -40,12 +41,50 @@ class WireguardUtils : public QObject {
   virtual bool deleteInterface() = 0;
 
   virtual bool updatePeer(const InterfaceConfig& config) = 0;
+  // Configure several peers at once. Backends that can batch the peers into
+  // a single transaction should override this.
+  // Nothing calls it with more than one peer yet: the daemon receives one
+  // hop per "activate" request and the client only sends single hop
+  // configs, so Daemon::activate() and switchServer() go through
+  // updatePeer(). Batching the hops needs a multi-hop activate request.
+  virtual bool updatePeers(const QList<InterfaceConfig>& configs) {
+    for (const InterfaceConfig& config : configs) {
+      if (!updatePeer(config)) {
+        return false;
+      }
+    }
+    return true;
+  }
   virtual bool deletePeer(const InterfaceConfig& config) = 0;
   virtual QList<PeerStatus> getPeerStatus() = 0;
 
   virtual bool updateRoutePrefix(const IPAddress& prefix) = 0;
   virtual bool deleteRoutePrefix(const IPAddress& prefix) = 0;
 
+  // Install the whole set of prefixes, aggregated, as one batch. If any of
+  // them fails, the prefixes installed so far are removed again.
+  virtual bool updateRoutePrefixes(const QList<IPAddress>& prefixes) {
+    QList<IPAddress> installed;
+    for (const IPAddress& prefix : IPAddress::aggregate(prefixes)) {
+      if (!updateRoutePrefix(prefix)) {
+        for (const IPAddress& ip : installed) {
+          deleteRoutePrefix(ip);
+        }
+        return false;
+      }
+      installed.append(prefix);
+    }
+    return true;
+  }
+  // Remove a set of prefixes previously installed by updateRoutePrefixes().
+  virtual bool deleteRoutePrefixes(const QList<IPAddress>& prefixes) {
+    bool result = true;
+    for (const IPAddress& prefix : IPAddress::aggregate(prefixes)) {
+      result = deleteRoutePrefix(prefix) && result;
+    }
+    return result;
+  }
+
   virtual bool addExclusionRoute(const IPAddress& prefix) = 0;
   virtual bool deleteExclusionRoute(const IPAddress& prefix) = 0;
 };
@@ -2,6 +2,7 @@
 #include <QTimer>
 
 #include "amnezia_application.h"
+#include "core/startupprofiler.h"
 #include "migrations.h"
 #include "version.h"
 
@@ -30,8 +31,13 @@ bool isAnotherInstanceRunning()
 
 int main(int argc, char *argv[])
 {
-    Migrations migrationsManager;
-    migrationsManager.doMigrations();
+    StartupProfiler::instance()->mark("main");
+
+    {
+        StartupProfiler::Scope phase("migrations");
+        Migrations migrationsManager;
+        migrationsManager.doMigrations();
+    }
 
 #ifdef Q_OS_WIN
     AllowSetForegroundWindow(ASFW_ANY);
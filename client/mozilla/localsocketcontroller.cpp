@@ -24,6 +24,11 @@ constexpr int MAX_CONNECTION_RETRY = 10;
 // How long do we wait between one try and the next one.
 constexpr int CONNECTION_RETRY_TIMER_MSEC = 500;
 
+// Status pushes from the daemon: at most one per interval, and only when the
+// traffic counters moved by the threshold or a handshake happened.
+constexpr int STATUS_PUSH_INTERVAL_MSEC = 1000;
+constexpr qint64 STATUS_PUSH_THRESHOLD_BYTES = 1024;
+
 namespace {
 Logger logger("LocalSocketController");
 }
@@ -107,6 +112,23 @@ void LocalSocketController::initializeInternal() {
 void LocalSocketController::daemonConnected() {
   logger.debug() << "Daemon connected";
   Q_ASSERT(m_daemonState == eInitializing);
+
+  // Reconnects start over with the legacy framing.
+  m_framer = MessageFramer();
+
+  QJsonObject json;
+  json.insert("type", "framing");
+  json.insert("framing", MessageFramer::framingName(MessageFramer::Cbor));
+  write(json);
+
+  // Let the daemon push status changes instead of polling it. Older
+  // daemons ignore the subscription.
+  QJsonObject subscribe;
+  subscribe.insert("type", "subscribe");
+  subscribe.insert("interval", STATUS_PUSH_INTERVAL_MSEC);
+  subscribe.insert("threshold", STATUS_PUSH_THRESHOLD_BYTES);
+  write(subscribe);
+
   checkStatus();
 }
 
@@ -328,37 +350,15 @@ void LocalSocketController::readData() {
 
   Q_ASSERT(m_socket);
   Q_ASSERT(m_daemonState == eInitializing || m_daemonState == eReady);
-  QByteArray input = m_socket->readAll();
-  m_buffer.append(input);
-
-  while (true) {
-    int pos = m_buffer.indexOf("\n");
-    if (pos == -1) {
-      break;
-    }
-
-    QByteArray line = m_buffer.left(pos);
-    m_buffer.remove(0, pos + 1);
-
-    QByteArray command(line);
-    command = command.trimmed();
-
-    if (command.isEmpty()) {
-      continue;
-    }
+  m_framer.append(m_socket->readAll());
 
-    parseCommand(command);
+  QJsonObject obj;
+  while (m_framer.takeMessage(obj)) {
+    parseCommand(obj);
   }
 }
 
-void LocalSocketController::parseCommand(const QByteArray& command) {
-  QJsonDocument json = QJsonDocument::fromJson(command);
-  if (!json.isObject()) {
-    logger.error() << "Invalid JSON - object expected";
-    return;
-  }
-
-  QJsonObject obj = json.object();
+void LocalSocketController::parseCommand(const QJsonObject& obj) {
   QJsonValue typeValue = obj.value("type");
   if (!typeValue.isString()) {
     logger.error() << "Invalid JSON - no type";
@@ -368,6 +368,17 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
 
   logger.debug() << "Parse command:" << type;
 
+  // The daemon accepted the framing we asked for. Older daemons ignore the
+  // request, in which case we keep sending JSON lines.
+  if (type == "framing") {
+    MessageFramer::Framing framing;
+    if (MessageFramer::parseFramingName(obj.value("framing").toString(),
+                                        framing)) {
+      m_framer.setWriteFraming(framing);
+    }
+    return;
+  }
+
   if (m_daemonState == eInitializing && type == "status") {
     m_daemonState = eReady;
 
@@ -426,13 +437,34 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
       return;
     }
 
-    emit statusUpdated(serverIpv4Gateway.toString(),
-                       deviceIpv4Address.toString(), txBytes.toDouble(),
-                       rxBytes.toDouble());
+    m_serverIpv4Gateway = serverIpv4Gateway.toString();
+    m_deviceIpv4Address = deviceIpv4Address.toString();
+    emit statusUpdated(m_serverIpv4Gateway, m_deviceIpv4Address,
+                       txBytes.toDouble(), rxBytes.toDouble());
+    return;
+  }
+
+  if (type == "statusDelta") {
+    // Deltas only follow a full status push.
+    if (m_serverIpv4Gateway.isEmpty()) {
+      return;
+    }
+
+    QJsonValue txBytes = obj.value("txBytes");
+    QJsonValue rxBytes = obj.value("rxBytes");
+    if (!txBytes.isDouble() || !rxBytes.isDouble()) {
+      logger.error() << "Unexpected statusDelta value";
+      return;
+    }
+
+    emit statusUpdated(m_serverIpv4Gateway, m_deviceIpv4Address,
+                       txBytes.toDouble(), rxBytes.toDouble());
     return;
   }
 
   if (type == "disconnected") {
+    m_serverIpv4Gateway.clear();
+    m_deviceIpv4Address.clear();
     disconnectInternal();
     return;
   }
@@ -468,12 +500,11 @@ void LocalSocketController::parseCommand(const QByteArray& command) {
     return;
   }
 
-  logger.warning() << "Invalid command received:" << command;
+  logger.warning() << "Invalid command received:" << type;
 }
 
 void LocalSocketController::write(const QJsonObject& json) {
   Q_ASSERT(m_socket);
-  m_socket->write(QJsonDocument(json).toJson(QJsonDocument::Compact));
-  m_socket->write("\n");
+  m_socket->write(m_framer.encode(json));
   m_socket->flush();
 }
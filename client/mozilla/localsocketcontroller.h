@@ -11,6 +11,7 @@
 #include <functional>
 
 #include "controllerimpl.h"
+#include "messageframer.h"
 
 class QJsonObject;
 
@@ -42,7 +43,7 @@ class LocalSocketController final : public ControllerImpl {
   void daemonConnected();
   void errorOccurred(QLocalSocket::LocalSocketError socketError);
   void readData();
-  void parseCommand(const QByteArray& command);
+  void parseCommand(const QJsonObject& obj);
 
   void write(const QJsonObject& json);
 
@@ -56,7 +57,11 @@ class LocalSocketController final : public ControllerImpl {
 
   QLocalSocket* m_socket = nullptr;
 
-  QByteArray m_buffer;
+  MessageFramer m_framer;
+
+  // Cached from the last full status, status deltas don't repeat them.
+  QString m_serverIpv4Gateway;
+  QString m_deviceIpv4Address;
 
   std::function<void(const QString&)> m_logCallback = nullptr;
 
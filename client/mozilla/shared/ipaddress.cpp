@@ -6,8 +6,92 @@
 
 #include <QtMath>
 
+#include <algorithm>
+#include <cstring>
+
 #include "leakdetector.h"
 
+namespace {
+
+// Raw network prefix used by IPAddress::aggregate(). IPv4 addresses only use
+// the first 4 bytes of the buffer.
+struct RawPrefix {
+  bool ipv6;
+  int length;
+  Q_IPV6ADDR bytes;
+
+  bool bit(int index) const { return bytes[index / 8] & (0x80 >> (index % 8)); }
+
+  bool contains(const RawPrefix& other) const {
+    if (ipv6 != other.ipv6 || length > other.length) {
+      return false;
+    }
+    for (int i = 0; i < length; ++i) {
+      if (bit(i) != other.bit(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Siblings share the same parent prefix and differ in the last bit only.
+  bool siblingOf(const RawPrefix& other) const {
+    if (ipv6 != other.ipv6 || length != other.length || length == 0) {
+      return false;
+    }
+    for (int i = 0; i < length - 1; ++i) {
+      if (bit(i) != other.bit(i)) {
+        return false;
+      }
+    }
+    return bit(length - 1) != other.bit(length - 1);
+  }
+
+  bool operator<(const RawPrefix& other) const {
+    if (ipv6 != other.ipv6) {
+      return !ipv6;
+    }
+    int cmp = memcmp(bytes.c, other.bytes.c, sizeof(bytes.c));
+    if (cmp != 0) {
+      return cmp < 0;
+    }
+    return length < other.length;
+  }
+};
+
+RawPrefix toRawPrefix(const IPAddress& ip) {
+  RawPrefix raw;
+  memset(raw.bytes.c, 0, sizeof(raw.bytes.c));
+  raw.length = ip.prefixLength();
+  raw.ipv6 = ip.type() == QAbstractSocket::IPv6Protocol;
+  if (raw.ipv6) {
+    raw.bytes = ip.address().toIPv6Address();
+  } else {
+    quint32 v4 = ip.address().toIPv4Address();
+    raw.bytes[0] = v4 >> 24;
+    raw.bytes[1] = v4 >> 16;
+    raw.bytes[2] = v4 >> 8;
+    raw.bytes[3] = v4;
+  }
+
+  // Clear the host bits.
+  for (int i = raw.length; i < 128; ++i) {
+    raw.bytes[i / 8] &= ~(0x80 >> (i % 8));
+  }
+  return raw;
+}
+
+IPAddress fromRawPrefix(const RawPrefix& raw) {
+  if (raw.ipv6) {
+    return IPAddress(QHostAddress(raw.bytes), raw.length);
+  }
+  quint32 v4 = (quint32(raw.bytes[0]) << 24) | (quint32(raw.bytes[1]) << 16) |
+               (quint32(raw.bytes[2]) << 8) | quint32(raw.bytes[3]);
+  return IPAddress(QHostAddress(v4), raw.length);
+}
+
+}  // namespace
+
 IPAddress::IPAddress() { MZ_COUNT_CTOR(IPAddress); }
 
 IPAddress::IPAddress(const QString& ip) {
@@ -255,6 +339,41 @@ QList<IPAddress> IPAddress::excludeAddresses(
   return results;
 }
 
+// static
+QList<IPAddress> IPAddress::aggregate(const QList<IPAddress>& list) {
+  QList<RawPrefix> sorted;
+  sorted.reserve(list.size());
+  for (const IPAddress& ip : list) {
+    if (ip.type() == QAbstractSocket::IPv4Protocol ||
+        ip.type() == QAbstractSocket::IPv6Protocol) {
+      sorted.append(toRawPrefix(ip));
+    }
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  // Sorted by address, a prefix is always followed by the prefixes it
+  // contains, and siblings end up next to each other.
+  QList<RawPrefix> stack;
+  for (const RawPrefix& prefix : sorted) {
+    if (!stack.isEmpty() && stack.last().contains(prefix)) {
+      continue;
+    }
+    stack.append(prefix);
+    while (stack.size() >= 2 &&
+           stack.at(stack.size() - 2).siblingOf(stack.last())) {
+      stack.removeLast();
+      stack.last().length--;
+    }
+  }
+
+  QList<IPAddress> result;
+  result.reserve(stack.size());
+  for (const RawPrefix& prefix : stack) {
+    result.append(fromRawPrefix(prefix));
+  }
+  return result;
+}
+
 QList<IPAddress> IPAddress::excludeAddresses(const IPAddress& ip) const {
   QList<IPAddress> sn = subnets();
   Q_ASSERT(sn.length() >= 2);
@@ -11,6 +11,9 @@ class IPAddress final {
  public:
   static QList<IPAddress> excludeAddresses(const QList<IPAddress>& sourceList,
                                            const QList<IPAddress>& excludeList);
+  // Returns the smallest list of prefixes covering the same addresses:
+  // duplicates and nested prefixes are dropped and sibling prefixes merged.
+  static QList<IPAddress> aggregate(const QList<IPAddress>& list);
 
   IPAddress();
   IPAddress(const QString& ip);
@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "messageframer.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QJsonDocument>
+#include <QtEndian>
+
+#include "leakdetector.h"
+#include "logger.h"
+
+constexpr char FRAME_MARKER = '\0';
+constexpr qsizetype FRAME_HEADER_SIZE = 1 + sizeof(quint32);
+
+// Nothing we exchange comes close to this, a bigger length means the stream
+// is corrupted.
+constexpr quint32 MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+namespace {
+Logger logger("MessageFramer");
+}
+
+MessageFramer::MessageFramer() { MZ_COUNT_CTOR(MessageFramer); }
+
+MessageFramer::~MessageFramer() { MZ_COUNT_DTOR(MessageFramer); }
+
+// static
+QString MessageFramer::framingName(Framing framing) {
+  switch (framing) {
+    case Cbor:
+      return "cbor";
+    case JsonLines:
+    default:
+      return "json";
+  }
+}
+
+// static
+bool MessageFramer::parseFramingName(const QString& name, Framing& framing) {
+  if (name == "cbor") {
+    framing = Cbor;
+    return true;
+  }
+  if (name == "json") {
+    framing = JsonLines;
+    return true;
+  }
+  return false;
+}
+
+QByteArray MessageFramer::encode(const QJsonObject& obj) const {
+  if (m_writeFraming == JsonLines) {
+    QByteArray data = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+    data.append('\n');
+    return data;
+  }
+
+  QByteArray payload = QCborMap::fromJsonObject(obj).toCborValue().toCbor();
+
+  QByteArray data;
+  data.reserve(FRAME_HEADER_SIZE + payload.size());
+  data.append(FRAME_MARKER);
+  char length[sizeof(quint32)];
+  qToBigEndian<quint32>(payload.size(), length);
+  data.append(length, sizeof(length));
+  data.append(payload);
+  return data;
+}
+
+void MessageFramer::append(const QByteArray& data) { m_buffer.append(data); }
+
+bool MessageFramer::takeMessage(QJsonObject& message) {
+  while (m_readPos < m_buffer.size()) {
+    const char* data = m_buffer.constData();
+
+    if (data[m_readPos] == FRAME_MARKER) {
+      if (m_buffer.size() - m_readPos < FRAME_HEADER_SIZE) {
+        break;
+      }
+
+      quint32 length = qFromBigEndian<quint32>(data + m_readPos + 1);
+      if (length > MAX_FRAME_SIZE) {
+        logger.error() << "Frame too large:" << length;
+        m_buffer.clear();
+        m_readPos = m_scanPos = 0;
+        return false;
+      }
+      if (m_buffer.size() - m_readPos - FRAME_HEADER_SIZE < length) {
+        break;
+      }
+
+      QCborParserError error;
+      QCborValue value = QCborValue::fromCbor(
+          data + m_readPos + FRAME_HEADER_SIZE, length, &error);
+      m_readPos += FRAME_HEADER_SIZE + length;
+      m_scanPos = m_readPos;
+
+      if (error.error != QCborError::NoError || !value.isMap()) {
+        logger.error() << "Invalid frame";
+        continue;
+      }
+      message = value.toMap().toJsonObject();
+      return true;
+    }
+
+    qsizetype pos = m_buffer.indexOf('\n', m_scanPos);
+    if (pos == -1) {
+      m_scanPos = m_buffer.size();
+      break;
+    }
+
+    QByteArray line =
+        QByteArray::fromRawData(data + m_readPos, pos - m_readPos).trimmed();
+    m_readPos = m_scanPos = pos + 1;
+
+    if (line.isEmpty()) {
+      continue;
+    }
+
+    QJsonDocument json = QJsonDocument::fromJson(line);
+    if (!json.isObject()) {
+      logger.error() << "Invalid JSON - object expected";
+      continue;
+    }
+    message = json.object();
+    return true;
+  }
+
+  compact();
+  return false;
+}
+
+void MessageFramer::compact() {
+  if (m_readPos >= m_buffer.size()) {
+    m_buffer.clear();
+    m_readPos = m_scanPos = 0;
+    return;
+  }
+
+  // Only move the pending bytes when they are less than what has been
+  // consumed, this keeps the total copying linear in the input size.
+  if (m_readPos > m_buffer.size() - m_readPos) {
+    m_buffer.remove(0, m_readPos);
+    m_scanPos -= m_readPos;
+    m_readPos = 0;
+  }
+}
@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MESSAGEFRAMER_H
+#define MESSAGEFRAMER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+
+// Message framing for the daemon local socket.
+//
+// Two wire formats are supported:
+// - JsonLines: one compact JSON object per line. This is the legacy format
+//   and the default for both sides.
+// - Cbor: a FRAME_MARKER byte, a big-endian 32-bit payload length and a
+//   CBOR encoded map.
+//
+// The reader accepts both formats at any time, the marker byte can never
+// start a JSON line. The writer format is switched once both peers agreed
+// on it through a "framing" message.
+class MessageFramer final {
+ public:
+  enum Framing {
+    JsonLines,
+    Cbor,
+  };
+
+  MessageFramer();
+  ~MessageFramer();
+
+  static QString framingName(Framing framing);
+  static bool parseFramingName(const QString& name, Framing& framing);
+
+  Framing writeFraming() const { return m_writeFraming; }
+  void setWriteFraming(Framing framing) { m_writeFraming = framing; }
+
+  QByteArray encode(const QJsonObject& obj) const;
+
+  void append(const QByteArray& data);
+
+  // Extracts the next complete message from the buffered data. Returns false
+  // when more data is needed. Malformed messages are logged and skipped.
+  bool takeMessage(QJsonObject& message);
+
+ private:
+  void compact();
+
+  Framing m_writeFraming = JsonLines;
+
+  // Incoming data is consumed by moving m_readPos forward, the buffer is
+  // only compacted once most of it has been consumed. m_scanPos remembers
+  // how far a partial JSON line was already searched for its newline.
+  QByteArray m_buffer;
+  qsizetype m_readPos = 0;
+  qsizetype m_scanPos = 0;
+};
+
+#endif  // MESSAGEFRAMER_H
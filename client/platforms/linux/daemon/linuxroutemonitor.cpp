@@ -10,6 +10,8 @@
 #include <QScopeGuard>
 #include <QTimer>
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -41,6 +43,14 @@ typedef struct wg_allowedip {
 
 constexpr const char* WG_INTERFACE = "amn0";
 
+constexpr size_t RTM_MAX_SIZE = sizeof(struct rtmsg) +
+                                2 * RTA_SPACE(sizeof(uint32_t)) +
+                                RTA_SPACE(sizeof(struct in6_addr));
+// Upper bound of a single batched netlink datagram.
+constexpr int RTM_BATCH_SIZE = 32 * 1024;
+// How long to wait for the kernel to acknowledge a batched datagram.
+constexpr int RTM_ACK_TIMEOUT_MSEC = 1000;
+
 static void nlmsg_append_attr(struct nlmsghdr* nlmsg, size_t maxlen,
                               int attrtype, const void* attrdata,
                               size_t attrlen);
@@ -91,49 +101,229 @@ static int memcmpzero(const void* data, size_t len) {
 }
 
 bool LinuxRouteMonitor::insertRoute(const IPAddress& prefix) {
-    logger.debug() << "Adding route to" << prefix.toString();
+    logger.debug().field("prefix", prefix) << "Adding route";
 
     const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK;
     return rtmSendRoute(RTM_NEWROUTE, flags, RTN_UNICAST, prefix);
 }
 
 bool LinuxRouteMonitor::deleteRoute(const IPAddress& prefix) {
-    logger.debug() << "Removing route to" << prefix.toString();
+    logger.debug().field("prefix", prefix) << "Removing route";
 
     const int flags = NLM_F_REQUEST | NLM_F_ACK;
     return rtmSendRoute(RTM_DELROUTE, flags, RTN_UNICAST, prefix);
 }
 
 bool LinuxRouteMonitor::addExclusionRoute(const IPAddress& prefix) {
-    logger.debug() << "Adding exclusion route for"
-                   << prefix.toString();
+    logger.debug().field("prefix", prefix) << "Adding exclusion route";
     const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK;
     return rtmSendRoute(RTM_NEWROUTE, flags, RTN_THROW, prefix);
 }
 
 bool LinuxRouteMonitor::deleteExclusionRoute(const IPAddress& prefix) {
-    logger.debug() << "Removing exclusion route for"
-                   << prefix.toString();
+    logger.debug().field("prefix", prefix) << "Removing exclusion route";
     const int flags = NLM_F_REQUEST | NLM_F_ACK;
     return rtmSendRoute(RTM_DELROUTE, flags, RTN_THROW, prefix);
 }
 
+bool LinuxRouteMonitor::insertRoutes(const QList<IPAddress>& prefixes) {
+    logger.debug().field("count", prefixes.size()) << "Adding routes";
+
+    const int flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE | NLM_F_ACK;
+    QList<IPAddress> applied;
+    if (rtmSendRoutes(RTM_NEWROUTE, flags, RTN_UNICAST, prefixes, &applied)) {
+        return true;
+    }
+
+    // Roll back the routes the kernel has accepted.
+    logger.warning() << "Route batch failed, rolling back" << applied.size()
+                     << "of" << prefixes.size() << "routes";
+    rtmSendRoutes(RTM_DELROUTE, NLM_F_REQUEST | NLM_F_ACK, RTN_UNICAST,
+                  applied);
+    return false;
+}
+
+bool LinuxRouteMonitor::deleteRoutes(const QList<IPAddress>& prefixes) {
+    logger.debug().field("count", prefixes.size()) << "Removing routes";
+
+    const int flags = NLM_F_REQUEST | NLM_F_ACK;
+    return rtmSendRoutes(RTM_DELROUTE, flags, RTN_UNICAST, prefixes);
+}
+
 bool LinuxRouteMonitor::rtmSendRoute(int action, int flags, int type,
                                        const IPAddress& prefix) {
-    constexpr size_t rtm_max_size = sizeof(struct rtmsg) +
-                                    2 * RTA_SPACE(sizeof(uint32_t)) +
-                                    RTA_SPACE(sizeof(struct in6_addr));
+    char buf[NLMSG_SPACE(RTM_MAX_SIZE)];
+    size_t len = rtmBuildRoute(buf, sizeof(buf), action, flags, type, prefix);
+    if (len == 0) {
+    return false;
+    }
+
+    struct sockaddr_nl nladdr;
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+    size_t result = sendto(m_nlsock, buf, len, 0,
+                           (struct sockaddr*)&nladdr, sizeof(nladdr));
+
+    return (result == len);
+}
+
+// Sends the routes packed into as few netlink datagrams as possible. Every
+// datagram is sent only after the kernel has acknowledged all messages of the
+// previous one. When adding, the first failed message stops the sending. When
+// deleting, the remaining datagrams are still sent, so that a route which is
+// already gone does not keep the others installed. The routes the kernel has
+// accepted are returned in applied.
+bool LinuxRouteMonitor::rtmSendRoutes(int action, int flags, int type,
+                                      const QList<IPAddress>& prefixes,
+                                      QList<IPAddress>* applied) {
+    const bool stopOnError = action != RTM_DELROUTE;
+    bool ok = true;
+
+    struct sockaddr_nl nladdr;
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    QByteArray batch;
+    batch.reserve(RTM_BATCH_SIZE);
+    int batchStart = 0;
+    quint32 batchSeq = m_nlseq;
+
+    auto flush = [&](int batchEnd) -> bool {
+    if (batch.isEmpty()) {
+        return true;
+    }
+    ssize_t size = batch.size();
+    ssize_t result = sendto(m_nlsock, batch.constData(), size, 0,
+                            (struct sockaddr*)&nladdr, sizeof(nladdr));
+    batch.truncate(0);
+    if (result != size) {
+        logger.warning() << "Netlink send failed:" << strerror(errno);
+        return false;
+    }
+
+    QList<int> errors;
+    bool ok = rtmReadAcks(batchSeq, batchEnd - batchStart, errors);
+    if (applied) {
+        for (int i = 0; i < errors.size(); ++i) {
+        if (errors.at(i) == 0) {
+            applied->append(prefixes.at(batchStart + i));
+        }
+        }
+    }
+    return ok;
+    };
+
+    for (int i = 0; i < prefixes.size(); ++i) {
+    if (batch.isEmpty()) {
+        batchStart = i;
+        batchSeq = m_nlseq;
+    }
+
+    char buf[NLMSG_SPACE(RTM_MAX_SIZE)];
+    size_t len = rtmBuildRoute(buf, sizeof(buf), action, flags, type,
+                               prefixes.at(i));
+    if (len == 0) {
+        // The next batch starts after the invalid route.
+        flush(i);
+        if (stopOnError) {
+        return false;
+        }
+        ok = false;
+        continue;
+    }
+
+    if (batch.size() + NLMSG_ALIGN(len) > RTM_BATCH_SIZE) {
+        // The route just built is the first one of the next batch.
+        quint32 nextSeq = m_nlseq - 1;
+        if (!flush(i)) {
+        if (stopOnError) {
+            return false;
+        }
+        ok = false;
+        }
+        batchStart = i;
+        batchSeq = nextSeq;
+    }
+    batch.append(buf, len);
+    batch.append(NLMSG_ALIGN(len) - len, '\0');
+    }
+
+    const bool flushed = flush(prefixes.size());
+    return flushed && ok;
+}
+
+// Reads the acknowledgements of count messages starting with sequence number
+// firstSeq. errors receives the netlink error of every message, -ETIMEDOUT
+// when it was not acknowledged in time.
+bool LinuxRouteMonitor::rtmReadAcks(quint32 firstSeq, int count,
+                                    QList<int>& errors) {
+    errors = QList<int>(count, -ETIMEDOUT);
+    int pending = count;
+    bool ok = true;
+
+    char buf[8192];
+    while (pending > 0) {
+    struct pollfd pfd;
+    pfd.fd = m_nlsock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, RTM_ACK_TIMEOUT_MSEC);
+    if (ready < 0 && errno == EINTR) {
+        continue;
+    }
+    if (ready <= 0) {
+        logger.warning() << "Netlink acknowledgement timed out," << pending
+                         << "messages pending";
+        return false;
+    }
+
+    ssize_t received = recv(m_nlsock, buf, sizeof(buf), MSG_DONTWAIT);
+    if (received <= 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+        continue;
+        }
+        logger.warning() << "Netlink receive failed:" << strerror(errno);
+        return false;
+    }
+
+    int len = static_cast<int>(received);
+    for (struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
+         NLMSG_OK(nlmsg, len); nlmsg = NLMSG_NEXT(nlmsg, len)) {
+        if (nlmsg->nlmsg_type != NLMSG_ERROR) {
+        continue;
+        }
+        // Replies to other requests, such as single routes, are skipped.
+        quint32 index = nlmsg->nlmsg_seq - firstSeq;
+        if (index >= static_cast<quint32>(count) ||
+            errors.at(index) != -ETIMEDOUT) {
+        continue;
+        }
+        struct nlmsgerr* err = static_cast<struct nlmsgerr*>(NLMSG_DATA(nlmsg));
+        errors[index] = err->error;
+        pending--;
+        if (err->error != 0) {
+        logger.debug() << "Netlink request failed:" << strerror(-err->error);
+        ok = false;
+        }
+    }
+    }
+
+    return ok;
+}
+
+size_t LinuxRouteMonitor::rtmBuildRoute(char* buf, size_t maxlen, int action,
+                                        int flags, int type,
+                                        const IPAddress& prefix) {
     wg_allowedip ip;
     if (!buildAllowedIp(&ip, prefix)) {
     logger.warning() << "Invalid destination prefix";
-    return false;
+    return 0;
     }
 
-    char buf[NLMSG_SPACE(rtm_max_size)];
     struct nlmsghdr* nlmsg = reinterpret_cast<struct nlmsghdr*>(buf);
     struct rtmsg* rtm = static_cast<struct rtmsg*>(NLMSG_DATA(nlmsg));
 
-    memset(buf, 0, sizeof(buf));
+    memset(buf, 0, maxlen);
     nlmsg->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
     nlmsg->nlmsg_type = action;
     nlmsg->nlmsg_flags = flags;
@@ -147,9 +337,9 @@ bool LinuxRouteMonitor::rtmSendRoute(int action, int flags, int type,
     rtm->rtm_scope = RT_SCOPE_UNIVERSE;
 
     if (rtm->rtm_family == AF_INET6) {
-    nlmsg_append_attr(nlmsg, sizeof(buf), RTA_DST, &ip.ip6, sizeof(ip.ip6));
+    nlmsg_append_attr(nlmsg, maxlen, RTA_DST, &ip.ip6, sizeof(ip.ip6));
     } else {
-    nlmsg_append_attr(nlmsg, sizeof(buf), RTA_DST, &ip.ip4, sizeof(ip.ip4));
+    nlmsg_append_attr(nlmsg, maxlen, RTA_DST, &ip.ip4, sizeof(ip.ip4));
     }
 
     if (rtm->rtm_type == RTN_UNICAST) {
@@ -157,27 +347,21 @@ bool LinuxRouteMonitor::rtmSendRoute(int action, int flags, int type,
 
     if (index <= 0) {
         logger.error() << "if_nametoindex() failed:" << strerror(errno);
-        return false;
+        return 0;
     }
-    nlmsg_append_attr32(nlmsg, sizeof(buf), RTA_OIF, index);
-    nlmsg_append_attr32(nlmsg, sizeof(buf), RTA_PRIORITY, 1);
+    nlmsg_append_attr32(nlmsg, maxlen, RTA_OIF, index);
+    nlmsg_append_attr32(nlmsg, maxlen, RTA_PRIORITY, 1);
     }
 
     if (rtm->rtm_type == RTN_THROW) {
     struct in_addr ip4;
     inet_pton(AF_INET, NetworkUtilities::getGatewayAndIface().toUtf8(), &ip4);
-    nlmsg_append_attr(nlmsg, sizeof(buf), RTA_GATEWAY, &ip4, sizeof(ip4));
-    nlmsg_append_attr32(nlmsg, sizeof(buf), RTA_PRIORITY, 0);
+    nlmsg_append_attr(nlmsg, maxlen, RTA_GATEWAY, &ip4, sizeof(ip4));
+    nlmsg_append_attr32(nlmsg, maxlen, RTA_PRIORITY, 0);
     rtm->rtm_type = RTN_UNICAST;
     }
 
-    struct sockaddr_nl nladdr;
-    memset(&nladdr, 0, sizeof(nladdr));
-    nladdr.nl_family = AF_NETLINK;
-    size_t result = sendto(m_nlsock, buf, nlmsg->nlmsg_len, 0,
-                           (struct sockaddr*)&nladdr, sizeof(nladdr));
-
-    return (result == nlmsg->nlmsg_len);
+    return nlmsg->nlmsg_len;
 }
 
 static void nlmsg_append_attr(struct nlmsghdr* nlmsg, size_t maxlen,
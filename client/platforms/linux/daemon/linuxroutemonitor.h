@@ -23,6 +23,8 @@ class LinuxRouteMonitor final : public QObject {
 
   bool insertRoute(const IPAddress& prefix);
   bool deleteRoute(const IPAddress& prefix);
+  bool insertRoutes(const QList<IPAddress>& prefixes);
+  bool deleteRoutes(const QList<IPAddress>& prefixes);
 
   bool addExclusionRoute(const IPAddress& prefix);
   bool deleteExclusionRoute(const IPAddress& prefix);
@@ -31,6 +33,12 @@ class LinuxRouteMonitor final : public QObject {
   static QString addrToString(const QByteArray& data);
   bool rtmSendRoute(int action, int flags, int type,
                     const IPAddress& prefix);
+  bool rtmSendRoutes(int action, int flags, int type,
+                     const QList<IPAddress>& prefixes,
+                     QList<IPAddress>* applied = nullptr);
+  bool rtmReadAcks(quint32 firstSeq, int count, QList<int>& errors);
+  size_t rtmBuildRoute(char* buf, size_t maxlen, int action, int flags,
+                       int type, const IPAddress& prefix);
   QString m_ifname;
   unsigned int m_ifindex = 0;
   int m_nlsock = -1;
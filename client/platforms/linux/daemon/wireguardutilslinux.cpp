@@ -10,6 +10,7 @@
 #include <QDir>
 #include <QFile>
 #include <QLocalSocket>
+#include <QTextStream>
 #include <QTimer>
 #include <QThread>
 
@@ -186,30 +187,67 @@ bool WireguardUtilsLinux::deleteInterface() {
     return true;
 }
 
-// dummy implementations for now
 bool WireguardUtilsLinux::updatePeer(const InterfaceConfig& config) {
-    QByteArray publicKey =
-        QByteArray::fromBase64(qPrintable(config.m_serverPublicKey));
+    return updatePeers({config});
+}
 
-    QByteArray pskKey = QByteArray::fromBase64(qPrintable(config.m_serverPskKey));
+bool WireguardUtilsLinux::updatePeers(const QList<InterfaceConfig>& configs) {
+    if (configs.isEmpty()) {
+        return true;
+    }
 
-    logger.debug() << "Configuring peer" << config.m_serverPublicKey << "via" << config.m_serverIpv4AddrIn;
+    for (const InterfaceConfig& config : configs) {
+        if (config.m_serverIpv4AddrIn.isNull() &&
+            config.m_serverIpv6AddrIn.isNull()) {
+            logger.warning() << "Failed to create peer with no endpoints";
+            return false;
+        }
+        logger.debug() << "Configuring peer" << config.m_serverPublicKey
+                       << "via" << config.m_serverIpv4AddrIn;
+    }
 
-    // Update/create the peer config
-    QString message;
-    QTextStream out(&message);
-    out << "set=1\n";
-    out << "public_key=" << QString(publicKey.toHex()) << "\n";
+    // Exclude the server addresses, except for multihop exit servers.
+    if (m_rtmonitor != nullptr) {
+        for (const InterfaceConfig& config : configs) {
+            if (config.m_hopType == InterfaceConfig::MultiHopExit) {
+                continue;
+            }
+            m_rtmonitor->addExclusionRoute(IPAddress(config.m_serverIpv4AddrIn));
+            m_rtmonitor->addExclusionRoute(IPAddress(config.m_serverIpv6AddrIn));
+        }
+    }
+
+    // Update/create all peers in a single UAPI transaction. The message is
+    // streamed into the socket peer by peer rather than built up front.
+    int err = uapiErrno(uapiCommand([&](QTextStream& out) {
+        out << "set=1\n";
+        for (const InterfaceConfig& config : configs) {
+            writePeerConfig(out, config);
+            out.flush();
+        }
+    }));
+    if (err != 0) {
+        logger.error() << "Peer configuration failed:" << strerror(err);
+    }
+    return (err == 0);
+}
+
+// static
+void WireguardUtilsLinux::writePeerConfig(QTextStream& out,
+                                          const InterfaceConfig& config) {
+    QByteArray publicKey =
+        QByteArray::fromBase64(qPrintable(config.m_serverPublicKey));
+
+    out << "public_key=" << publicKey.toHex() << "\n";
     if (!config.m_serverPskKey.isNull()) {
-        out << "preshared_key=" << QString(pskKey.toHex()) << "\n";
+        QByteArray pskKey =
+            QByteArray::fromBase64(qPrintable(config.m_serverPskKey));
+        out << "preshared_key=" << pskKey.toHex() << "\n";
     }
     if (!config.m_serverIpv4AddrIn.isNull()) {
         out << "endpoint=" << config.m_serverIpv4AddrIn << ":";
-    } else if (!config.m_serverIpv6AddrIn.isNull()) {
-        out << "endpoint=[" << config.m_serverIpv6AddrIn << "]:";
     } else {
-        logger.warning() << "Failed to create peer with no endpoints";
-        return false;
+        out << "endpoint=[" << config.m_serverIpv6AddrIn << "]:";
     }
     out << config.m_serverPort << "\n";
 
@@ -218,19 +256,6 @@ bool WireguardUtilsLinux::updatePeer(const InterfaceConfig& config) {
     for (const IPAddress& ip : config.m_allowedIPAddressRanges) {
         out << "allowed_ip=" << ip.toString() << "\n";
     }
-
-    // Exclude the server address, except for multihop exit servers.
-    if ((config.m_hopType != InterfaceConfig::MultiHopExit) &&
-        (m_rtmonitor != nullptr)) {
-        m_rtmonitor->addExclusionRoute(IPAddress(config.m_serverIpv4AddrIn));
-        m_rtmonitor->addExclusionRoute(IPAddress(config.m_serverIpv6AddrIn));
-    }
-
-    int err = uapiErrno(uapiCommand(message));
-    if (err != 0) {
-        logger.error() << "Peer configuration failed:" << strerror(err);
-    }
-    return (err == 0);
 }
 
 bool WireguardUtilsLinux::deletePeer(const InterfaceConfig& config) {
@@ -277,6 +302,9 @@ QList<WireguardUtils::PeerStatus> WireguardUtilsLinux::getPeerStatus() {
             status = PeerStatus(pubkey.toBase64());
         }
 
+        if (name == "endpoint") {
+            status.m_endpoint = value;
+        }
         if (name == "tx_bytes") {
             status.m_txBytes = value.toDouble();
         }
@@ -348,7 +376,7 @@ bool WireguardUtilsLinux::deleteRoutePrefix(const IPAddress& prefix) {
         return false;
     }
     if (prefix.prefixLength() > 0) {
-        return m_rtmonitor->insertRoute(prefix);
+        return m_rtmonitor->deleteRoute(prefix);
     }
 
     // Ensure that we do not replace the default route.
@@ -363,6 +391,42 @@ bool WireguardUtilsLinux::deleteRoutePrefix(const IPAddress& prefix) {
     }
 }
 
+bool WireguardUtilsLinux::updateRoutePrefixes(const QList<IPAddress>& prefixes) {
+    if (!m_rtmonitor) {
+        return false;
+    }
+    return m_rtmonitor->insertRoutes(routesForPrefixes(prefixes));
+}
+
+bool WireguardUtilsLinux::deleteRoutePrefixes(const QList<IPAddress>& prefixes) {
+    if (!m_rtmonitor) {
+        return false;
+    }
+    return m_rtmonitor->deleteRoutes(routesForPrefixes(prefixes));
+}
+
+// static
+QList<IPAddress> WireguardUtilsLinux::routesForPrefixes(
+    const QList<IPAddress>& prefixes) {
+    QList<IPAddress> routes;
+    for (const IPAddress& prefix : IPAddress::aggregate(prefixes)) {
+        if (prefix.prefixLength() > 0) {
+            routes.append(prefix);
+            continue;
+        }
+
+        // Ensure that we do not replace the default route.
+        if (prefix.type() == QAbstractSocket::IPv4Protocol) {
+            routes.append(IPAddress("0.0.0.0/1"));
+            routes.append(IPAddress("128.0.0.0/1"));
+        } else if (prefix.type() == QAbstractSocket::IPv6Protocol) {
+            routes.append(IPAddress("::/1"));
+            routes.append(IPAddress("8000::/1"));
+        }
+    }
+    return routes;
+}
+
 bool WireguardUtilsLinux::addExclusionRoute(const IPAddress& prefix) {
     if (!m_rtmonitor) {
         return false;
@@ -378,6 +442,16 @@ bool WireguardUtilsLinux::deleteExclusionRoute(const IPAddress& prefix) {
 }
 
 QString WireguardUtilsLinux::uapiCommand(const QString& command) {
+    return uapiCommand([&](QTextStream& out) {
+        out << command;
+        if (!command.endsWith('\n')) {
+            out << '\n';
+        }
+    });
+}
+
+QString WireguardUtilsLinux::uapiCommand(
+    const std::function<void(QTextStream&)>& writer) {
     QLocalSocket socket;
     QTimer uapiTimeout;
     QDir wgRuntimeDir(WG_RUNTIME_DIR);
@@ -393,12 +467,14 @@ QString WireguardUtilsLinux::uapiCommand(const QString& command) {
         return QString();
     }
 
-    // Send the message to the UAPI socket.
-    QByteArray message = command.toLocal8Bit();
-    while (!message.endsWith("\n\n")) {
-        message.append('\n');
+    // Stream the message to the UAPI socket. The writer emits
+    // newline-terminated lines, an empty line ends the transaction.
+    {
+        QTextStream out(&socket);
+        writer(out);
+        out << '\n';
+        out.flush();
     }
-    socket.write(message);
 
     QByteArray reply;
     while (!reply.contains("\n\n")) {
@@ -7,6 +7,9 @@
 
 #include <QObject>
 #include <QProcess>
+#include <QTextStream>
+
+#include <functional>
 
 
 #include "daemon/wireguardutils.h"
@@ -29,11 +32,14 @@ public:
     bool deleteInterface() override;
 
     bool updatePeer(const InterfaceConfig& config) override;
+    bool updatePeers(const QList<InterfaceConfig>& configs) override;
     bool deletePeer(const InterfaceConfig& config) override;
     QList<PeerStatus> getPeerStatus() override;
 
     bool updateRoutePrefix(const IPAddress& prefix) override;
     bool deleteRoutePrefix(const IPAddress& prefix) override;
+    bool updateRoutePrefixes(const QList<IPAddress>& prefixes) override;
+    bool deleteRoutePrefixes(const QList<IPAddress>& prefixes) override;
 
     bool addExclusionRoute(const IPAddress& prefix) override;
     bool deleteExclusionRoute(const IPAddress& prefix) override;
@@ -47,8 +53,11 @@ private slots:
 
 private:
     QString uapiCommand(const QString& command);
+    QString uapiCommand(const std::function<void(QTextStream&)>& writer);
+    static void writePeerConfig(QTextStream& out, const InterfaceConfig& config);
     static int uapiErrno(const QString& command);
     QString waitForTunnelName(const QString& filename);
+    static QList<IPAddress> routesForPrefixes(const QList<IPAddress>& prefixes);
 
     QString m_ifname;
     QProcess m_tunnel;
@@ -278,6 +278,9 @@ QList<WireguardUtils::PeerStatus> WireguardUtilsMacos::getPeerStatus() {
       status = PeerStatus(pubkey.toBase64());
     }
 
+    if (name == "endpoint") {
+      status.m_endpoint = value;
+    }
     if (name == "tx_bytes") {
       status.m_txBytes = value.toDouble();
     }
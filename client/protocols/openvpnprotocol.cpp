@@ -12,6 +12,10 @@
 #include "utilities.h"
 #include "version.h"
 
+namespace {
+    Logger logger("OpenVpnProtocol");
+}
+
 OpenVpnProtocol::OpenVpnProtocol(const QJsonObject &configuration, QObject *parent) : VpnProtocol(configuration, parent)
 {
     readOpenVpnConfiguration(configuration);
@@ -68,11 +72,11 @@ ErrorCode OpenVpnProtocol::prepare()
         return ErrorCode::AmneziaServiceConnectionFailed;
     }
 
-    QRemoteObjectPendingReply<QStringList> resultCheck = IpcClient::Interface()->getTapList();
+    QRemoteObjectPendingReply<QStringList> resultCheck = IpcClient::call("getTapList", &IpcInterfaceReplica::getTapList);
     resultCheck.waitForFinished();
 
     if (resultCheck.returnValue().isEmpty()) {
-        QRemoteObjectPendingReply<bool> resultInstall = IpcClient::Interface()->checkAndInstallDriver();
+        QRemoteObjectPendingReply<bool> resultInstall = IpcClient::call("checkAndInstallDriver", &IpcInterfaceReplica::checkAndInstallDriver);
         resultInstall.waitForFinished();
 
         if (!resultInstall.returnValue())
@@ -263,8 +267,9 @@ void OpenVpnProtocol::onReadyReadDataFromManagementServer()
             return;
         }
 
-        if (!line.contains(">BYTECOUNT")) {
-            qDebug().noquote() << line;
+        // Management output is only looked at when debug records are kept
+        if (logger.isEnabled(LogLevel::Debug) && !line.contains(">BYTECOUNT")) {
+            logger.debug() << line;
         }
 
         if (line.contains(">INFO:OpenVPN Management Interface")) {
@@ -19,6 +19,10 @@ WireguardProtocol::WireguardProtocol(const QJsonObject &configuration, QObject *
             });
     connect(m_impl.get(), &ControllerImpl::disconnected, this,
             [this]() { emit connectionStateChanged(Vpn::ConnectionState::Disconnected); });
+    connect(m_impl.get(), &ControllerImpl::statusUpdated, this,
+            [this](const QString &, const QString &, uint64_t txBytes, uint64_t rxBytes) {
+                setBytesChanged(rxBytes, txBytes);
+            });
     m_impl->initialize(nullptr, nullptr);
 }
 
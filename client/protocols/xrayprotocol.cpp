@@ -5,6 +5,7 @@
 #include "core/networkUtilities.h"
 
 #include <QCryptographicHash>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkInterface>
@@ -113,29 +114,51 @@ ErrorCode XrayProtocol::startTun2Sock()
 #ifdef Q_OS_WIN
                     QThread::msleep(8000);
 #endif
+#if defined(Q_OS_LINUX) || defined(Q_OS_MACOS)
 #ifdef Q_OS_MACOS
                     QThread::msleep(5000);
-                    IpcClient::Interface()->createTun("utun22", amnezia::protocols::xray::defaultLocalAddr);
-                    IpcClient::Interface()->updateResolvers("utun22", dnsAddr);
-#endif
-#ifdef Q_OS_LINUX
+                    const QString tunName = "utun22";
+#else
                     QThread::msleep(1000);
-                    IpcClient::Interface()->createTun("tun2", amnezia::protocols::xray::defaultLocalAddr);
-                    IpcClient::Interface()->updateResolvers("tun2", dnsAddr);
+                    const QString tunName = "tun2";
 #endif
-#if defined(Q_OS_LINUX) || defined(Q_OS_MACOS)
+                    // Tun, resolvers, kill switch and routes are applied by the service in one call,
+                    // which also rolls them back if one of the steps fails
+                    QJsonObject plan;
+                    plan.insert("tun", QJsonObject { { "dev", tunName }, { "subnet", amnezia::protocols::xray::defaultLocalAddr } });
+                    QJsonArray resolvers;
+                    for (const QHostAddress &addr : dnsAddr) {
+                        resolvers.append(addr.toString());
+                    }
+                    plan.insert("resolvers", QJsonObject { { "ifname", tunName }, { "servers", resolvers } });
+
                     // killSwitch toggle
                     if (QVariant(m_configData.value(config_key::killSwitchOption).toString()).toBool()) {
                         m_configData.insert("vpnServer", m_remoteAddress);
-                        IpcClient::Interface()->enableKillSwitch(m_configData, 0);
+                        plan.insert("killSwitch", m_configData);
                     }
-#endif
+                    if (m_routeMode == 0) {
+                        plan.insert("routes", QJsonArray {
+                            QJsonObject { { "gateway", m_vpnGateway }, { "ips", QJsonArray { "0.0.0.0/1", "128.0.0.0/1" } } },
+                            QJsonObject { { "gateway", m_routeGateway }, { "ips", QJsonArray { m_remoteAddress } } } });
+                    }
+                    plan.insert("stopRoutingIpv6", true);
+
+                    QRemoteObjectPendingReply<bool> result = IpcClient::call("applyConnectionPlan", &IpcInterfaceReplica::applyConnectionPlan, plan);
+                    if (!result.waitForFinished(10000) || !result.returnValue()) {
+                        qCritical() << "Failed to apply the connection plan";
+                        setLastError(ErrorCode::AmneziaServiceConnectionFailed);
+                        stop();
+                        return;
+                    }
+#else
                     if (m_routeMode == 0) {
                         IpcClient::Interface()->routeAddList(m_vpnGateway, QStringList() << "0.0.0.0/1");
                         IpcClient::Interface()->routeAddList(m_vpnGateway, QStringList() << "128.0.0.0/1");
                         IpcClient::Interface()->routeAddList(m_routeGateway, QStringList() << m_remoteAddress);
                     }
                     IpcClient::Interface()->StopRoutingIpv6();
+#endif
 #ifdef Q_OS_WIN
                     IpcClient::Interface()->updateResolvers("tun2", dnsAddr);
                     QList<QNetworkInterface> netInterfaces = QNetworkInterface::allInterfaces();
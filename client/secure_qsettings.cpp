@@ -1,8 +1,9 @@
 #include "secure_qsettings.h"
 
 #include "QAead.h"
-#include "QBlockCipher.h"
+#include "core/startupprofiler.h"
 #include "utilities.h"
+#include <QCoreApplication>
 #include <QDataStream>
 #include <QDebug>
 #include <QEventLoop>
@@ -13,17 +14,32 @@
 #include <QSharedPointer>
 #include <QTimer>
 
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+    #include <windows.h>
+#elif defined(Q_OS_UNIX)
+    #include <sys/mman.h>
+#endif
+
 using namespace QKeychain;
 
 SecureQSettings::SecureQSettings(const QString &organization, const QString &application, QObject *parent)
-    : QObject { parent }, m_settings(organization, application, parent), encryptedKeys({ "Servers/serversList" })
+    : QObject { parent }, m_settings(organization, application, parent), encryptedKeys({ "Servers/serversList", "Servers/server/" })
 {
+    m_syncTimer.setSingleShot(true);
+    m_syncTimer.setInterval(SYNC_QUIET_PERIOD_MSEC);
+    connect(&m_syncTimer, &QTimer::timeout, this, &SecureQSettings::sync);
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &SecureQSettings::sync);
+    }
+
     bool encrypted = m_settings.value("Conf/encrypted").toBool();
 
     // convert settings to encrypted for if updated to >= 2.1.0
     if (encryptionRequired() && !encrypted) {
         for (const QString &key : m_settings.allKeys()) {
-            if (encryptedKeys.contains(key)) {
+            if (isEncryptedKey(key)) {
                 const QVariant &val = value(key);
                 setValue(key, val);
             }
@@ -33,6 +49,23 @@ SecureQSettings::SecureQSettings(const QString &organization, const QString &app
     }
 }
 
+SecureQSettings::~SecureQSettings()
+{
+    sync();
+    unlockKey(m_key);
+    unlockKey(m_iv);
+}
+
+bool SecureQSettings::isEncryptedKey(const QString &key) const
+{
+    for (const QString &encryptedKey : encryptedKeys) {
+        if (encryptedKey.endsWith('/') ? key.startsWith(encryptedKey) : key == encryptedKey) {
+            return true;
+        }
+    }
+    return false;
+}
+
 QVariant SecureQSettings::value(const QString &key, const QVariant &defaultValue) const
 {
     QMutexLocker locker(&mutex);
@@ -56,6 +89,8 @@ QVariant SecureQSettings::value(const QString &key, const QVariant &defaultValue
                 return {};
             }
 
+            // Values are decrypted on first access and then served from the cache
+            StartupProfiler::Scope phase("decryption");
             QByteArray encryptedValue = retVal.toByteArray().mid(magicString.size());
 
             QByteArray decryptedValue = decryptText(encryptedValue);
@@ -81,7 +116,7 @@ void SecureQSettings::setValue(const QString &key, const QVariant &value)
 {
     QMutexLocker locker(&mutex);
 
-    if (encryptionRequired() && encryptedKeys.contains(key)) {
+    if (encryptionRequired() && isEncryptedKey(key)) {
         if (!getEncKey().isEmpty() && !getEncIv().isEmpty()) {
             QByteArray decryptedValue;
             {
@@ -101,7 +136,7 @@ void SecureQSettings::setValue(const QString &key, const QVariant &value)
     }
 
     m_cache.insert(key, value);
-    sync();
+    scheduleSync(key);
 }
 
 void SecureQSettings::remove(const QString &key)
@@ -111,11 +146,42 @@ void SecureQSettings::remove(const QString &key)
     m_settings.remove(key);
     m_cache.remove(key);
 
-    sync();
+    scheduleSync(key);
+}
+
+void SecureQSettings::scheduleSync(const QString &key)
+{
+    // Every change used to be followed by an explicit sync, a full rewrite of the file.
+    // The timer coalesces these commits, a burst of changes ends up in one write.
+    // Server records hold the credentials, which can not be recovered once lost, so
+    // they are written at once and a burst of them costs one write per change.
+    // Called with the mutex held.
+    m_dirty = true;
+    for (const QString &group : m_immediateSyncGroups) {
+        if (key.startsWith(group)) {
+            // A pending timer finds nothing left to write
+            syncLocked();
+            return;
+        }
+    }
+    QMetaObject::invokeMethod(&m_syncTimer, [this]() { m_syncTimer.start(); });
 }
 
 void SecureQSettings::sync()
 {
+    QMutexLocker locker(&mutex);
+
+    m_syncTimer.stop();
+    syncLocked();
+}
+
+void SecureQSettings::syncLocked()
+{
+    if (!m_dirty) {
+        return;
+    }
+    m_dirty = false;
+    // QSettings writes the file through QSaveFile, so it is replaced atomically
     m_settings.sync();
 }
 
@@ -173,10 +239,9 @@ bool SecureQSettings::restoreAppConfig(const QByteArray &json)
 
 QByteArray SecureQSettings::encryptText(const QByteArray &value) const
 {
-    QSimpleCrypto::QBlockCipher cipher;
     QByteArray result;
     try {
-        result = cipher.encryptAesBlockCipher(value, getEncKey(), getEncIv());
+        result = m_cipher.encryptAesBlockCipher(value, getEncKey(), getEncIv());
     } catch (...) { // todo change error handling in QSimpleCrypto?
         qCritical() << "error when encrypting the settings value";
     }
@@ -185,10 +250,9 @@ QByteArray SecureQSettings::encryptText(const QByteArray &value) const
 
 QByteArray SecureQSettings::decryptText(const QByteArray &ba) const
 {
-    QSimpleCrypto::QBlockCipher cipher;
     QByteArray result;
     try {
-        result = cipher.decryptAesBlockCipher(ba, getEncKey(), getEncIv());
+        result = m_cipher.decryptAesBlockCipher(ba, getEncKey(), getEncIv());
     } catch (...) { // todo change error handling in QSimpleCrypto?
         qCritical() << "error when decrypting the settings value";
     }
@@ -205,54 +269,96 @@ bool SecureQSettings::encryptionRequired() const
 }
 
 QByteArray SecureQSettings::getEncKey() const
+{
+    return loadKeys() ? m_key : QByteArray();
+}
+
+QByteArray SecureQSettings::getEncIv() const
+{
+    return loadKeys() ? m_iv : QByteArray();
+}
+
+bool SecureQSettings::loadKeys() const
+{
+    if (m_keysLoaded) {
+        return true;
+    }
+
+    StartupProfiler::Scope phase("keychain");
+
+    // Every keychain request runs a nested event loop, so it is done once per process.
+    // A failed attempt is not cached and will be retried on the next call.
+    QByteArray key = loadKey(settingsKeyTag, "key");
+    if (key.isEmpty()) {
+        return false;
+    }
+    QByteArray iv = loadKey(settingsIvTag, "IV");
+    if (iv.isEmpty()) {
+        return false;
+    }
+
+    m_key = key;
+    m_iv = iv;
+    lockKey(m_key);
+    lockKey(m_iv);
+    m_keysLoaded = true;
+    return true;
+}
+
+QByteArray SecureQSettings::loadKey(const QString &tag, const char *name) const
 {
     // load keys from system key storage
-    m_key = getSecTag(settingsKeyTag);
+    QByteArray stored = getSecTag(tag);
 
-    if (m_key.isEmpty()) {
+    if (stored.isEmpty()) {
         // Create new key
-        QSimpleCrypto::QBlockCipher cipher;
-        QByteArray key = cipher.generatePrivateSalt(32);
+        QByteArray key = m_cipher.generatePrivateSalt(32);
         if (key.isEmpty()) {
-            qCritical() << "SecureQSettings::getEncKey Unable to generate new enc key";
+            qCritical() << "SecureQSettings::loadKey Unable to generate new enc" << name;
         }
 
-        setSecTag(settingsKeyTag, key);
+        setSecTag(tag, key);
 
         // check
-        m_key = getSecTag(settingsKeyTag);
-        if (key != m_key) {
-            qCritical() << "SecureQSettings::getEncKey Unable to store key in keychain" << key.size() << m_key.size();
+        stored = getSecTag(tag);
+        if (key != stored) {
+            qCritical() << "SecureQSettings::loadKey Unable to store" << name << "in keychain" << key.size() << stored.size();
             return {};
         }
     }
 
-    return m_key;
+    return stored;
 }
 
-QByteArray SecureQSettings::getEncIv() const
+void SecureQSettings::lockKey(QByteArray &key)
 {
-    // load keys from system key storage
-    m_iv = getSecTag(settingsIvTag);
-
-    if (m_iv.isEmpty()) {
-        // Create new IV
-        QSimpleCrypto::QBlockCipher cipher;
-        QByteArray iv = cipher.generatePrivateSalt(32);
-        if (iv.isEmpty()) {
-            qCritical() << "SecureQSettings::getEncIv Unable to generate new enc IV";
-        }
-        setSecTag(settingsIvTag, iv);
-
-        // check
-        m_iv = getSecTag(settingsIvTag);
-        if (iv != m_iv) {
-            qCritical() << "SecureQSettings::getEncIv Unable to store IV in keychain" << iv.size() << m_iv.size();
-            return {};
-        }
+    // Keep the key material out of swap
+    if (key.isEmpty()) {
+        return;
     }
+    char *data = key.data(); // detaches, so the locked buffer is owned by this object
+#if defined(Q_OS_WIN)
+    VirtualLock(data, key.size());
+#elif defined(Q_OS_UNIX)
+    mlock(data, key.size());
+#else
+    Q_UNUSED(data)
+#endif
+}
 
-    return m_iv;
+void SecureQSettings::unlockKey(QByteArray &key)
+{
+    if (key.isEmpty()) {
+        return;
+    }
+    char *data = key.data();
+    std::fill(data, data + key.size(), '\0');
+#if defined(Q_OS_WIN)
+    VirtualUnlock(data, key.size());
+#elif defined(Q_OS_UNIX)
+    munlock(data, key.size());
+#endif
+    key.clear();
 }
 
 QByteArray SecureQSettings::getSecTag(const QString &tag)
@@ -291,8 +397,11 @@ void SecureQSettings::setSecTag(const QString &tag, const QByteArray &data)
 
 void SecureQSettings::clearSettings()
 {
-    QMutexLocker locker(&mutex);
-    m_settings.clear();
-    m_cache.clear();
+    {
+        QMutexLocker locker(&mutex);
+        m_settings.clear();
+        m_cache.clear();
+        m_dirty = true;
+    }
     sync();
 }
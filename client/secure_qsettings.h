@@ -5,7 +5,9 @@
 #include <QMutexLocker>
 #include <QObject>
 #include <QSettings>
+#include <QTimer>
 
+#include "QBlockCipher.h"
 #include "keychain.h"
 
 constexpr const char *settingsKeyTag = "settingsKeyTag";
@@ -19,8 +21,12 @@ class SecureQSettings : public QObject
 public:
     explicit SecureQSettings(const QString &organization, const QString &application = QString(),
                              QObject *parent = nullptr);
+    ~SecureQSettings() override;
 
     Q_INVOKABLE QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+    // Server records are written to disk at once. Other changes are written after
+    // SYNC_QUIET_PERIOD_MSEC without further changes, or on sync(), which is the explicit
+    // commit point. A crash within that period loses them.
     Q_INVOKABLE void setValue(const QString &key, const QVariant &value);
     void remove(const QString &key);
     void sync();
@@ -33,6 +39,7 @@ public:
 
     bool encryptionRequired() const;
 
+    // Key and IV are read from the keychain once per process and kept in locked memory
     QByteArray getEncKey() const;
     QByteArray getEncIv() const;
 
@@ -42,11 +49,28 @@ public:
     void clearSettings();
 
 private:
+    static constexpr int SYNC_QUIET_PERIOD_MSEC = 500;
+
+    void scheduleSync(const QString &key);
+    void syncLocked();
+    bool loadKeys() const;
+    QByteArray loadKey(const QString &tag, const char *name) const;
+    static void lockKey(QByteArray &key);
+    static void unlockKey(QByteArray &key);
+
     QSettings m_settings;
+    QTimer m_syncTimer;
+    bool m_dirty = false;
 
     mutable QMap<QString, QVariant> m_cache;
 
-    QStringList encryptedKeys; // encode only key listed here
+    bool isEncryptedKey(const QString &key) const;
+
+    QStringList encryptedKeys; // encode only key listed here, keys ending with '/' cover the whole group
+    // changes under these groups are not left to the sync timer
+    QStringList m_immediateSyncGroups = {
+        "Servers/",
+    };
     // only this fields need for backup
     QStringList m_fieldsToBackup = {
         "Conf/", "Servers/",
@@ -54,6 +78,8 @@ private:
 
     mutable QByteArray m_key;
     mutable QByteArray m_iv;
+    mutable bool m_keysLoaded = false;
+    mutable QSimpleCrypto::QBlockCipher m_cipher;
 
     const QByteArray magicString { "EncData" }; // Magic keyword used for mark encrypted QByteArray
 
@@ -1,7 +1,10 @@
 #include "settings.h"
 
 #include "QCoreApplication"
+#include "QDir"
+#include "QStandardPaths"
 #include "QThread"
+#include "QUuid"
 
 #include "core/networkUtilities.h"
 #include "version.h"
@@ -15,10 +18,27 @@ namespace
     const char cloudFlareNs2[] = "1.0.0.1";
 
     constexpr char gatewayEndpoint[] = "http://gw.amnezia.org:80/";
+
+    // Older versions kept all servers in one encrypted JSON array
+    constexpr char legacyServersListKey[] = "Servers/serversList";
+    constexpr char serverIdsKey[] = "Servers/ids";
+    constexpr char serverKeyPrefix[] = "Servers/server/";
+
+    QString serverKey(const QString &id)
+    {
+        return serverKeyPrefix + id;
+    }
+
+    QString newServerId()
+    {
+        return QUuid::createUuid().toString(QUuid::WithoutBraces);
+    }
 }
 
 Settings::Settings(QObject *parent) : QObject(parent), m_settings(ORGANIZATION_NAME, APPLICATION_NAME, this)
 {
+    migrateServersList();
+
     // Import old settings
     if (serversCount() == 0) {
         QString user = value("Server/userName").toString();
@@ -46,46 +66,155 @@ Settings::Settings(QObject *parent) : QObject(parent), m_settings(ORGANIZATION_N
     m_gatewayEndpoint = gatewayEndpoint;
 }
 
+void Settings::migrateServersList()
+{
+    const QVariant legacy = value(legacyServersListKey);
+    if (!legacy.isValid()) {
+        return;
+    }
+
+    const QJsonArray servers = QJsonDocument::fromJson(legacy.toByteArray()).array();
+    setServersArray(servers);
+    m_settings.remove(legacyServersListKey);
+    m_settings.sync();
+
+    qDebug() << "Settings: migrated" << servers.size() << "servers to per server records";
+}
+
+void Settings::resetServersCache()
+{
+    QMutexLocker locker(&m_serversMutex);
+    m_serverIds.clear();
+    m_serverIdsLoaded = false;
+    m_serversCache.clear();
+}
+
+QStringList Settings::serverIds() const
+{
+    {
+        QMutexLocker locker(&m_serversMutex);
+        if (m_serverIdsLoaded) {
+            return m_serverIds;
+        }
+    }
+
+    // value() may block on the main thread, so it is not called with the mutex held
+    const QStringList ids = value(serverIdsKey).toStringList();
+
+    QMutexLocker locker(&m_serversMutex);
+    m_serverIds = ids;
+    m_serverIdsLoaded = true;
+    return m_serverIds;
+}
+
+void Settings::setServerIds(const QStringList &ids)
+{
+    {
+        QMutexLocker locker(&m_serversMutex);
+        m_serverIds = ids;
+        m_serverIdsLoaded = true;
+    }
+    setValue(serverIdsKey, ids);
+}
+
+void Settings::writeServer(const QString &id, const QJsonObject &server)
+{
+    {
+        QMutexLocker locker(&m_serversMutex);
+        m_serversCache.insert(id, server);
+    }
+    setValue(serverKey(id), QJsonDocument(server).toJson(QJsonDocument::Compact));
+}
+
+QJsonArray Settings::serversArray() const
+{
+    QJsonArray servers;
+    const QStringList ids = serverIds();
+    for (int i = 0; i < ids.size(); ++i) {
+        servers.append(server(i));
+    }
+    return servers;
+}
+
+void Settings::setServersArray(const QJsonArray &servers)
+{
+    for (const QString &id : serverIds()) {
+        m_settings.remove(serverKey(id));
+    }
+    {
+        QMutexLocker locker(&m_serversMutex);
+        m_serversCache.clear();
+    }
+
+    QStringList ids;
+    for (const QJsonValue &server : servers) {
+        const QString id = newServerId();
+        writeServer(id, server.toObject());
+        ids.append(id);
+    }
+    setServerIds(ids);
+}
+
 int Settings::serversCount() const
 {
-    return serversArray().size();
+    return serverIds().size();
 }
 
 QJsonObject Settings::server(int index) const
 {
-    const QJsonArray &servers = serversArray();
-    if (index >= servers.size())
+    const QStringList ids = serverIds();
+    if (index < 0 || index >= ids.size())
         return QJsonObject();
 
-    return servers.at(index).toObject();
+    const QString &id = ids.at(index);
+    {
+        QMutexLocker locker(&m_serversMutex);
+        const auto it = m_serversCache.constFind(id);
+        if (it != m_serversCache.constEnd()) {
+            return it.value();
+        }
+    }
+
+    const QJsonObject server = QJsonDocument::fromJson(value(serverKey(id)).toByteArray()).object();
+
+    QMutexLocker locker(&m_serversMutex);
+    m_serversCache.insert(id, server);
+    return server;
 }
 
 void Settings::addServer(const QJsonObject &server)
 {
-    QJsonArray servers = serversArray();
-    servers.append(server);
-    setServersArray(servers);
+    const QString id = newServerId();
+    writeServer(id, server);
+
+    QStringList ids = serverIds();
+    ids.append(id);
+    setServerIds(ids);
 }
 
 void Settings::removeServer(int index)
 {
-    QJsonArray servers = serversArray();
-    if (index >= servers.size())
+    QStringList ids = serverIds();
+    if (index < 0 || index >= ids.size())
         return;
 
-    servers.removeAt(index);
-    setServersArray(servers);
+    const QString id = ids.takeAt(index);
+    setServerIds(ids);
+    m_settings.remove(serverKey(id));
+    {
+        QMutexLocker locker(&m_serversMutex);
+        m_serversCache.remove(id);
+    }
     emit serverRemoved(index);
 }
 
 bool Settings::editServer(int index, const QJsonObject &server)
 {
-    QJsonArray servers = serversArray();
-    if (index >= servers.size())
+    const QStringList ids = serverIds();
+    if (index < 0 || index >= ids.size())
         return false;
 
-    servers.replace(index, server);
-    setServersArray(servers);
+    writeServer(ids.at(index), server);
     return true;
 }
 
@@ -274,87 +403,145 @@ void Settings::setSitesSplitTunnelingEnabled(bool enabled)
     setValue("Conf/sitesSplitTunnelingEnabled", enabled);
 }
 
+QString Settings::siteJournalPath(RouteMode mode) const
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    return QDir(dir).filePath("sites_" + routeModeString(mode) + ".journal");
+}
+
+std::shared_ptr<SiteStore> Settings::siteStore(RouteMode mode) const
+{
+    {
+        QMutexLocker locker(&m_siteStoresMutex);
+        const auto it = m_siteStores.constFind(mode);
+        if (it != m_siteStores.constEnd()) {
+            return it.value();
+        }
+    }
+
+    // value() may block on the main thread, so it is not called with the mutex held
+    const QVariantMap snapshot = value("Conf/" + routeModeString(mode)).toMap();
+
+    QMutexLocker locker(&m_siteStoresMutex);
+    std::shared_ptr<SiteStore> &store = m_siteStores[mode];
+    if (!store) {
+        store = std::make_shared<SiteStore>(siteJournalPath(mode));
+        store->load(snapshot);
+    }
+    return store;
+}
+
+void Settings::compactVpnSites(RouteMode mode, const std::shared_ptr<SiteStore> &store, bool force)
+{
+    if (!force && !store->needsCompaction()) {
+        return;
+    }
+
+    // The journal is dropped only after the snapshot is on disk
+    setValue("Conf/" + routeModeString(mode), store->toMap());
+    m_settings.sync();
+    store->resetJournal();
+}
+
+void Settings::resetSiteStores()
+{
+    // Journals belong to the snapshots that have just been replaced
+    QMutexLocker locker(&m_siteStoresMutex);
+    m_siteStores.clear();
+    for (RouteMode mode : { VpnAllSites, VpnOnlyForwardSites, VpnAllExceptSites }) {
+        QFile::remove(siteJournalPath(mode));
+    }
+}
+
+QVariantMap Settings::vpnSites(RouteMode mode) const
+{
+    return siteStore(mode)->toMap();
+}
+
+void Settings::setVpnSites(RouteMode mode, const QVariantMap &sites)
+{
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
+    store->replace(sites);
+    compactVpnSites(mode, store, true);
+}
+
 bool Settings::addVpnSite(RouteMode mode, const QString &site, const QString &ip)
 {
-    QVariantMap sites = vpnSites(mode);
-    if (sites.contains(site) && ip.isEmpty())
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
+    if (store->contains(site) && ip.isEmpty())
         return false;
 
-    sites.insert(site, ip);
-    setVpnSites(mode, sites);
+    store->insert(site, ip);
+    compactVpnSites(mode, store);
     return true;
 }
 
 void Settings::addVpnSites(RouteMode mode, const QMap<QString, QString> &sites)
 {
-    QVariantMap allSites = vpnSites(mode);
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
     for (auto i = sites.constBegin(); i != sites.constEnd(); ++i) {
-        const QString &site = i.key();
-        const QString &ip = i.value();
+        store->insert(i.key(), i.value());
+    }
+    compactVpnSites(mode, store);
+}
 
-        if (allSites.contains(site) && allSites.value(site) == ip)
-            continue;
+QStringList Settings::getVpnIps(RouteMode mode) const
+{
+    return siteStore(mode)->ips();
+}
 
-        allSites.insert(site, ip);
-    }
+bool Settings::containsVpnIp(RouteMode mode, const QString &ip) const
+{
+    return siteStore(mode)->containsAddress(ip);
+}
 
-    setVpnSites(mode, allSites);
+QStringList Settings::getVpnDomains(RouteMode mode) const
+{
+    return siteStore(mode)->domains();
 }
 
-QStringList Settings::getVpnIps(RouteMode mode) const
+QByteArray Settings::getVpnRoutePrefixes(RouteMode mode) const
 {
-    QStringList ips;
-    const QVariantMap &m = vpnSites(mode);
-    for (auto i = m.constBegin(); i != m.constEnd(); ++i) {
-        if (NetworkUtilities::checkIpSubnetFormat(i.key())) {
-            ips.append(i.key());
-        } else if (NetworkUtilities::checkIpSubnetFormat(i.value().toString())) {
-            ips.append(i.value().toString());
-        }
-    }
-    ips.removeDuplicates();
-    return ips;
+    return siteStore(mode)->routePrefixes();
 }
 
 void Settings::removeVpnSite(RouteMode mode, const QString &site)
 {
-    QVariantMap sites = vpnSites(mode);
-    if (!sites.contains(site))
-        return;
-
-    sites.remove(site);
-    setVpnSites(mode, sites);
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
+    if (store->remove(site)) {
+        compactVpnSites(mode, store);
+    }
 }
 
 void Settings::addVpnIps(RouteMode mode, const QStringList &ips)
 {
-    QVariantMap sites = vpnSites(mode);
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
     for (const QString &ip : ips) {
         if (ip.isEmpty())
             continue;
 
-        sites.insert(ip, "");
+        store->insert(ip);
     }
-
-    setVpnSites(mode, sites);
+    compactVpnSites(mode, store);
 }
 
 void Settings::removeVpnSites(RouteMode mode, const QStringList &sites)
 {
-    QVariantMap sitesMap = vpnSites(mode);
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
     for (const QString &site : sites) {
         if (site.isEmpty())
             continue;
 
-        sitesMap.remove(site);
+        store->remove(site);
     }
-
-    setVpnSites(mode, sitesMap);
+    compactVpnSites(mode, store);
 }
 
 void Settings::removeAllVpnSites(RouteMode mode)
 {
-    setVpnSites(mode, QVariantMap());
+    const std::shared_ptr<SiteStore> store = siteStore(mode);
+    store->clear();
+    compactVpnSites(mode, store, true);
 }
 
 QString Settings::primaryDns() const
@@ -371,6 +558,8 @@ void Settings::clearSettings()
 {
     auto uuid = getInstallationUuid(false);
     m_settings.clearSettings();
+    resetServersCache();
+    resetSiteStores();
     setInstallationUuid(uuid);
     emit settingsCleared();
 }
@@ -420,7 +609,6 @@ void Settings::setVpnApps(AppsRouteMode mode, const QVector<InstalledAppInfo> &a
         appsArray.push_back(appInfo);
     }
     setValue("Conf/" + appsRouteModeString(mode), appsArray);
-    m_settings.sync();
 }
 
 bool Settings::isAppsSplitTunnelingEnabled() const
@@ -469,6 +657,36 @@ void Settings::setInstallationUuid(const QString &uuid)
     setValue("Conf/installationUuid", uuid);
 }
 
+QByteArray Settings::backupAppConfig()
+{
+    for (RouteMode mode : { VpnAllSites, VpnOnlyForwardSites, VpnAllExceptSites }) {
+        compactVpnSites(mode, siteStore(mode), true);
+    }
+
+    // Backups keep the single array layout, so they can be restored by older versions
+    QJsonObject cfg = QJsonDocument::fromJson(m_settings.backupAppConfig()).object();
+    for (const QString &key : cfg.keys()) {
+        if (key == serverIdsKey || key.startsWith(serverKeyPrefix)) {
+            cfg.remove(key);
+        }
+    }
+    cfg.insert(legacyServersListKey, QString::fromUtf8(QJsonDocument(serversArray()).toJson()));
+
+    return QJsonDocument(cfg).toJson();
+}
+
+bool Settings::restoreAppConfig(const QByteArray &cfg)
+{
+    if (!m_settings.restoreAppConfig(cfg)) {
+        return false;
+    }
+
+    resetServersCache();
+    migrateServersList();
+    resetSiteStores();
+    return true;
+}
+
 ServerCredentials Settings::defaultServerCredentials() const
 {
     return serverCredentials(defaultServerIndex());
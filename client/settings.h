@@ -1,6 +1,8 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <QHash>
+#include <QMutex>
 #include <QObject>
 #include <QSettings>
 #include <QString>
@@ -9,8 +11,11 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 
+#include <memory>
+
 #include "containers/containers_defs.h"
 #include "core/defs.h"
+#include "core/sitestore.h"
 #include "secure_qsettings.h"
 
 using namespace amnezia;
@@ -27,14 +32,10 @@ public:
     ServerCredentials defaultServerCredentials() const;
     ServerCredentials serverCredentials(int index) const;
 
-    QJsonArray serversArray() const
-    {
-        return QJsonDocument::fromJson(value("Servers/serversList").toByteArray()).array();
-    }
-    void setServersArray(const QJsonArray &servers)
-    {
-        setValue("Servers/serversList", QJsonDocument(servers).toJson());
-    }
+    // Every server is stored in its own record, see serverIds(). These two build
+    // and replace the whole list, single server operations only touch one record.
+    QJsonArray serversArray() const;
+    void setServersArray(const QJsonArray &servers);
 
     // Servers section
     int serversCount() const;
@@ -118,18 +119,14 @@ public:
     bool isSitesSplitTunnelingEnabled() const;
     void setSitesSplitTunnelingEnabled(bool enabled);
 
-    QVariantMap vpnSites(RouteMode mode) const
-    {
-        return value("Conf/" + routeModeString(mode)).toMap();
-    }
-    void setVpnSites(RouteMode mode, const QVariantMap &sites)
-    {
-        setValue("Conf/" + routeModeString(mode), sites);
-        m_settings.sync();
-    }
+    QVariantMap vpnSites(RouteMode mode) const;
+    void setVpnSites(RouteMode mode, const QVariantMap &sites);
     bool addVpnSite(RouteMode mode, const QString &site, const QString &ip = "");
     void addVpnSites(RouteMode mode, const QMap<QString, QString> &sites); // map <site, ip>
     QStringList getVpnIps(RouteMode mode) const;
+    bool containsVpnIp(RouteMode mode, const QString &ip) const;
+    QStringList getVpnDomains(RouteMode mode) const;
+    QByteArray getVpnRoutePrefixes(RouteMode mode) const; // packed, see routeprefixes.h
     void removeVpnSite(RouteMode mode, const QString &site);
 
     void addVpnIps(RouteMode mode, const QStringList &ip);
@@ -163,14 +160,8 @@ public:
     //    static constexpr char openNicNs5[] = "94.103.153.176";
     //    static constexpr char openNicNs13[] = "144.76.103.143";
 
-    QByteArray backupAppConfig() const
-    {
-        return m_settings.backupAppConfig();
-    }
-    bool restoreAppConfig(const QByteArray &cfg)
-    {
-        return m_settings.restoreAppConfig(cfg);
-    }
+    QByteArray backupAppConfig();
+    bool restoreAppConfig(const QByteArray &cfg);
 
     QLocale getAppLanguage()
     {
@@ -234,8 +225,29 @@ private:
 
     void setInstallationUuid(const QString &uuid);
 
+    QStringList serverIds() const;
+    void setServerIds(const QStringList &ids);
+    void writeServer(const QString &id, const QJsonObject &server);
+    void migrateServersList();
+    void resetServersCache();
+
+    QString siteJournalPath(RouteMode mode) const;
+    // Callers keep the store alive, resetSiteStores() may drop it from another thread
+    std::shared_ptr<SiteStore> siteStore(RouteMode mode) const;
+    void compactVpnSites(RouteMode mode, const std::shared_ptr<SiteStore> &store, bool force = false);
+    void resetSiteStores();
+
     mutable SecureQSettings m_settings;
 
+    // Server ids in display order and lazily parsed server records, keyed by id
+    mutable QMutex m_serversMutex;
+    mutable QStringList m_serverIds;
+    mutable bool m_serverIdsLoaded = false;
+    mutable QHash<QString, QJsonObject> m_serversCache;
+
+    mutable QMutex m_siteStoresMutex;
+    mutable QHash<RouteMode, std::shared_ptr<SiteStore>> m_siteStores;
+
     QString m_gatewayEndpoint;
     bool m_isDevGatewayEnv = false;
 };
@@ -100,8 +100,10 @@ void SettingsController::exportLogsFile(const QString &fileName)
 {
 #ifdef Q_OS_ANDROID
     AndroidController::instance()->exportLogsFile(fileName);
-#else
+#elif defined(Q_OS_IOS)
     SystemController::saveFile(fileName, Logger::getLogFile());
+#else
+    SystemController::saveFile(fileName, [](QIODevice &file) { return Logger::exportLogs(false, file); });
 #endif
 }
 
@@ -110,7 +112,7 @@ void SettingsController::exportServiceLogsFile(const QString &fileName)
 #ifdef Q_OS_ANDROID
     AndroidController::instance()->exportLogsFile(fileName);
 #else
-    SystemController::saveFile(fileName, Logger::getServiceLogFile());
+    SystemController::saveFile(fileName, [](QIODevice &file) { return Logger::exportLogs(true, file); });
 #endif
 }
 
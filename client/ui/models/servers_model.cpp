@@ -306,7 +306,7 @@ void ServersModel::addServer(const QJsonObject &server)
 void ServersModel::editServer(const QJsonObject &server, const int serverIndex)
 {
     m_settings->editServer(serverIndex, server);
-    m_servers.replace(serverIndex, m_settings->serversArray().at(serverIndex));
+    m_servers.replace(serverIndex, m_settings->server(serverIndex));
     emit dataChanged(index(serverIndex, 0), index(serverIndex, 0));
 
     if (serverIndex == m_defaultServerIndex) {
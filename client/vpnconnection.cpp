@@ -4,6 +4,7 @@
 #include <QEventLoop>
 #include <QFile>
 #include <QHostInfo>
+#include <QJsonArray>
 #include <QJsonObject>
 
 #include "core/controllers/serverController.h"
@@ -60,30 +61,43 @@ void VpnConnection::onConnectionStateChanged(Vpn::ConnectionState state)
 
     if (IpcClient::Interface()) {
         if (state == Vpn::ConnectionState::Connected) {
-            IpcClient::Interface()->resetIpStack();
-            IpcClient::Interface()->flushDns();
+            // Stack reset, route changes and dns flush are sent to the service as one plan
+            QJsonObject plan;
+            plan.insert("resetIpStack", true);
+            plan.insert("flushDns", true);
 
             if (!m_vpnConfiguration.value(config_key::configVersion).toInt() && container != DockerContainer::Awg
                 && container != DockerContainer::WireGuard) {
                 QString dns1 = m_vpnConfiguration.value(config_key::dns1).toString();
                 QString dns2 = m_vpnConfiguration.value(config_key::dns2).toString();
 
-                IpcClient::Interface()->routeAddList(m_vpnProtocol->vpnGateway(), QStringList() << dns1 << dns2);
+                QJsonArray routes;
+                routes.append(QJsonObject { { "gateway", m_vpnProtocol->vpnGateway() }, { "ips", QJsonArray { dns1, dns2 } } });
 
                 if (m_settings->isSitesSplitTunnelingEnabled()) {
-                    IpcClient::Interface()->routeDeleteList(m_vpnProtocol->vpnGateway(), QStringList() << "0.0.0.0");
-                    // qDebug() << "VpnConnection::onConnectionStateChanged :: adding custom routes, count:" << forwardIps.size();
-                    if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
-                        QTimer::singleShot(1000, m_vpnProtocol.data(),
-                                           [this]() { addSitesRoutes(m_vpnProtocol->vpnGateway(), m_settings->routeMode()); });
-                    } else if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
-                        IpcClient::Interface()->routeAddList(m_vpnProtocol->vpnGateway(), QStringList() << "0.0.0.0/1");
-                        IpcClient::Interface()->routeAddList(m_vpnProtocol->vpnGateway(), QStringList() << "128.0.0.0/1");
-
-                        IpcClient::Interface()->routeAddList(m_vpnProtocol->routeGateway(), QStringList() << remoteAddress());
-                        addSitesRoutes(m_vpnProtocol->routeGateway(), m_settings->routeMode());
+                    plan.insert("deleteRoutes",
+                                QJsonArray { QJsonObject { { "gateway", m_vpnProtocol->vpnGateway() }, { "ips", QJsonArray { "0.0.0.0" } } } });
+
+                    if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
+                        routes.append(QJsonObject { { "gateway", m_vpnProtocol->vpnGateway() },
+                                                    { "ips", QJsonArray { "0.0.0.0/1", "128.0.0.0/1" } } });
+                        routes.append(QJsonObject { { "gateway", m_vpnProtocol->routeGateway() }, { "ips", QJsonArray { remoteAddress() } } });
                     }
                 }
+                plan.insert("routes", routes);
+            }
+
+            IpcClient::call("applyConnectionPlan", &IpcInterfaceReplica::applyConnectionPlan, plan);
+
+            if (!m_vpnConfiguration.value(config_key::configVersion).toInt() && container != DockerContainer::Awg
+                && container != DockerContainer::WireGuard && m_settings->isSitesSplitTunnelingEnabled()) {
+                // qDebug() << "VpnConnection::onConnectionStateChanged :: adding custom routes, count:" << forwardIps.size();
+                if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
+                    QTimer::singleShot(1000, m_vpnProtocol.data(),
+                                       [this]() { addSitesRoutes(m_vpnProtocol->vpnGateway(), m_settings->routeMode()); });
+                } else if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
+                    addSitesRoutes(m_vpnProtocol->routeGateway(), m_settings->routeMode());
+                }
             }
 
         } else if (state == Vpn::ConnectionState::Error) {
@@ -97,6 +111,9 @@ void VpnConnection::onConnectionStateChanged(Vpn::ConnectionState state)
         } else if (state == Vpn::ConnectionState::Connecting) {
 
         } else if (state == Vpn::ConnectionState::Disconnected) {
+            // Both sides of the privileged calls made during the session end up in the logs
+            IpcCallTrace::instance()->dump();
+            IpcClient::Interface()->dumpIpcTrace();
         }
     }
 #endif
@@ -119,35 +136,23 @@ const QString &VpnConnection::remoteAddress() const
 void VpnConnection::addSitesRoutes(const QString &gw, Settings::RouteMode mode)
 {
 #ifdef AMNEZIA_DESKTOP
-    QStringList ips;
-    QStringList sites;
-    const QVariantMap &m = m_settings->vpnSites(mode);
-    for (auto i = m.constBegin(); i != m.constEnd(); ++i) {
-        if (NetworkUtilities::checkIpSubnetFormat(i.key())) {
-            ips.append(i.key());
-        } else {
-            if (NetworkUtilities::checkIpSubnetFormat(i.value().toString())) {
-                ips.append(i.value().toString());
-            }
-            sites.append(i.key());
-        }
-    }
-    ips.removeDuplicates();
+    // the site store keeps addresses already classified and parsed
+    const QStringList &sites = m_settings->getVpnDomains(mode);
 
-    // add all IPs immediately
-    IpcClient::Interface()->routeAddList(gw, ips);
+    // add all IPs immediately, as packed prefixes to keep big lists cheap
+    IpcClient::routeAddPrefixes(gw, m_settings->getVpnRoutePrefixes(mode));
 
     // re-resolve domains
     for (const QString &site : sites) {
-        const auto &cbResolv = [this, site, gw, mode, ips](const QHostInfo &hostInfo) {
+        const auto &cbResolv = [this, site, gw, mode](const QHostInfo &hostInfo) {
             const QList<QHostAddress> &addresses = hostInfo.addresses();
             QString ipv4Addr;
             for (const QHostAddress &addr : hostInfo.addresses()) {
                 if (addr.protocol() == QAbstractSocket::NetworkLayerProtocol::IPv4Protocol) {
                     const QString &ip = addr.toString();
                     // qDebug() << "VpnConnection::addSitesRoutes updating site" << site << ip;
-                    if (!ips.contains(ip)) {
-                        IpcClient::Interface()->routeAddList(gw, QStringList() << ip);
+                    if (!m_settings->containsVpnIp(mode, ip)) {
+                        IpcClient::call("routeAddList", &IpcInterfaceReplica::routeAddList, gw, QStringList() << ip);
                         m_settings->addVpnSite(mode, site, ip);
                     }
                     flushDns();
@@ -170,9 +175,9 @@ void VpnConnection::addRoutes(const QStringList &ips)
 #ifdef AMNEZIA_DESKTOP
     if (connectionState() == Vpn::ConnectionState::Connected && IpcClient::Interface()) {
         if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
-            IpcClient::Interface()->routeAddList(m_vpnProtocol->vpnGateway(), ips);
+            IpcClient::routeAddPrefixes(m_vpnProtocol->vpnGateway(), amnezia::routePrefixesFromStrings(ips));
         } else if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
-            IpcClient::Interface()->routeAddList(m_vpnProtocol->routeGateway(), ips);
+            IpcClient::routeAddPrefixes(m_vpnProtocol->routeGateway(), amnezia::routePrefixesFromStrings(ips));
         }
     }
 #endif
@@ -183,9 +188,9 @@ void VpnConnection::deleteRoutes(const QStringList &ips)
 #ifdef AMNEZIA_DESKTOP
     if (connectionState() == Vpn::ConnectionState::Connected && IpcClient::Interface()) {
         if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
-            IpcClient::Interface()->routeDeleteList(vpnProtocol()->vpnGateway(), ips);
+            IpcClient::routeDeletePrefixes(vpnProtocol()->vpnGateway(), amnezia::routePrefixesFromStrings(ips));
         } else if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
-            IpcClient::Interface()->routeDeleteList(m_vpnProtocol->routeGateway(), ips);
+            IpcClient::routeDeletePrefixes(m_vpnProtocol->routeGateway(), amnezia::routePrefixesFromStrings(ips));
         }
     }
 #endif
@@ -417,7 +422,7 @@ void VpnConnection::disconnectFromVpn()
         IpcClient::Interface()->flushDns();
 
         // delete cached routes
-        QRemoteObjectPendingReply<bool> response = IpcClient::Interface()->clearSavedRoutes();
+        QRemoteObjectPendingReply<bool> response = IpcClient::call("clearSavedRoutes", &IpcInterfaceReplica::clearSavedRoutes);
         response.waitForFinished(1000);
     }
 #endif
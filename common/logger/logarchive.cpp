@@ -0,0 +1,223 @@
+#include "logarchive.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+#include <algorithm>
+
+// Qt bundles zlib on the platforms without a system one
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#else
+#include <QtZlib/zlib.h>
+#endif
+
+namespace {
+    constexpr qint64 exportChunkSize = 64 * 1024;
+    constexpr int compressionLevel = 6;
+    // Selects the gzip wrapper instead of the zlib one, see deflateInit2()
+    constexpr int gzipWindowBits = 16 + MAX_WBITS;
+
+    enum class StreamResult { Ok, BadInput, WriteFailed };
+
+    bool writeOutput(QIODevice &out, const QByteArray &buffer, const z_stream &stream)
+    {
+        const qint64 produced = buffer.size() - stream.avail_out;
+        return out.write(buffer.constData(), produced) == produced;
+    }
+
+    // Compresses the rest of in into one gzip member, in chunks
+    StreamResult gzipStream(QIODevice &in, QIODevice &out)
+    {
+        z_stream stream {};
+        if (deflateInit2(&stream, compressionLevel, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return StreamResult::WriteFailed;
+        }
+
+        QByteArray buffer(exportChunkSize, Qt::Uninitialized);
+        StreamResult result = StreamResult::Ok;
+        int flush = Z_NO_FLUSH;
+        while (result == StreamResult::Ok && flush != Z_FINISH) {
+            QByteArray chunk = in.read(exportChunkSize);
+            if (chunk.isEmpty() && !in.atEnd()) {
+                result = StreamResult::BadInput;
+                break;
+            }
+            flush = in.atEnd() ? Z_FINISH : Z_NO_FLUSH;
+            stream.next_in = reinterpret_cast<Bytef *>(chunk.data());
+            stream.avail_in = static_cast<uInt>(chunk.size());
+
+            do {
+                stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+                stream.avail_out = static_cast<uInt>(buffer.size());
+                deflate(&stream, flush);
+                if (!writeOutput(out, buffer, stream)) {
+                    result = StreamResult::WriteFailed;
+                    break;
+                }
+            } while (stream.avail_out == 0);
+        }
+
+        deflateEnd(&stream);
+        return result;
+    }
+
+    // Decompresses all gzip members of in, in chunks. zlib checks the CRC-32 and
+    // size in the trailer of each member.
+    StreamResult gunzipStream(QIODevice &in, QIODevice &out)
+    {
+        z_stream stream {};
+        if (inflateInit2(&stream, gzipWindowBits) != Z_OK) {
+            return StreamResult::BadInput;
+        }
+
+        QByteArray buffer(exportChunkSize, Qt::Uninitialized);
+        QByteArray chunk;
+        StreamResult result = StreamResult::Ok;
+        bool outputFull = false;
+        bool memberDone = false;
+        while (true) {
+            // Output may still be pending after the input is used up
+            if (stream.avail_in == 0 && !outputFull) {
+                if (in.atEnd()) {
+                    break;
+                }
+                chunk = in.read(exportChunkSize);
+                if (chunk.isEmpty()) {
+                    result = StreamResult::BadInput;
+                    break;
+                }
+                stream.next_in = reinterpret_cast<Bytef *>(chunk.data());
+                stream.avail_in = static_cast<uInt>(chunk.size());
+            }
+
+            stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+            stream.avail_out = static_cast<uInt>(buffer.size());
+            const int status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                result = StreamResult::BadInput;
+                break;
+            }
+            if (!writeOutput(out, buffer, stream)) {
+                result = StreamResult::WriteFailed;
+                break;
+            }
+
+            memberDone = status == Z_STREAM_END;
+            outputFull = !memberDone && stream.avail_out == 0;
+            if (memberDone) {
+                // The next member, if any, starts right after this one
+                inflateReset(&stream);
+            }
+        }
+
+        inflateEnd(&stream);
+        if (result == StreamResult::Ok && !memberDone) {
+            result = StreamResult::BadInput;
+        }
+        return result;
+    }
+}
+
+QString LogArchive::archivePath(const QString &logFilePath, int index)
+{
+    return QString("%1.%2.gz").arg(logFilePath).arg(index);
+}
+
+bool LogArchive::rotate(const QString &logFilePath, int maxArchives)
+{
+    QFile log(logFilePath);
+    if (!log.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (log.size() == 0) {
+        return true;
+    }
+
+    if (maxArchives > 0) {
+        QFile::remove(archivePath(logFilePath, maxArchives));
+        for (int i = maxArchives - 1; i >= 1; --i) {
+            if (QFile::exists(archivePath(logFilePath, i))) {
+                QFile::rename(archivePath(logFilePath, i), archivePath(logFilePath, i + 1));
+            }
+        }
+
+        QSaveFile archive(archivePath(logFilePath, 1));
+        if (!archive.open(QIODevice::WriteOnly) || gzipStream(log, archive) != StreamResult::Ok || !archive.commit()) {
+            return false;
+        }
+    }
+
+    log.close();
+    return log.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+void LogArchive::removeArchives(const QString &logFilePath)
+{
+    const QStringList files = segments(logFilePath);
+    for (const QString &file : files) {
+        if (file != logFilePath) {
+            QFile::remove(file);
+        }
+    }
+}
+
+QStringList LogArchive::segments(const QString &logFilePath)
+{
+    const QFileInfo info(logFilePath);
+    const QRegularExpression archiveName("^" + QRegularExpression::escape(info.fileName()) + "\\.(\\d+)\\.gz$");
+
+    QList<QPair<int, QString>> archives;
+    const QStringList entries = info.absoluteDir().entryList({ info.fileName() + ".*.gz" }, QDir::Files);
+    for (const QString &entry : entries) {
+        const QRegularExpressionMatch match = archiveName.match(entry);
+        if (match.hasMatch()) {
+            archives.append({ match.captured(1).toInt(), info.absoluteDir().filePath(entry) });
+        }
+    }
+
+    // Higher index means older archive
+    std::sort(archives.begin(), archives.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    QStringList result;
+    for (const auto &archive : archives) {
+        result.append(archive.second);
+    }
+    if (info.exists()) {
+        result.append(logFilePath);
+    }
+    return result;
+}
+
+bool LogArchive::exportTo(const QString &logFilePath, QIODevice &out)
+{
+    const QStringList files = segments(logFilePath);
+    for (const QString &path : files) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        if (path == logFilePath) {
+            while (!file.atEnd()) {
+                const QByteArray chunk = file.read(exportChunkSize);
+                if (chunk.isEmpty() || out.write(chunk) != chunk.size()) {
+                    return chunk.isEmpty();
+                }
+            }
+            continue;
+        }
+
+        const StreamResult result = gunzipStream(file, out);
+        if (result == StreamResult::WriteFailed) {
+            return false;
+        }
+        if (result == StreamResult::BadInput) {
+            out.write(QString("\nLog archive %1 is damaged, the rest of it is skipped\n").arg(QFileInfo(path).fileName()).toUtf8());
+        }
+    }
+    return true;
+}
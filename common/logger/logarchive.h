@@ -0,0 +1,34 @@
+#ifndef LOGARCHIVE_H
+#define LOGARCHIVE_H
+
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief The LogArchive class - Rotated log segments stored next to the log file
+ *
+ * A log file "name.log" is rotated into gzip archives "name.log.1.gz" (newest)
+ * up to "name.log.N.gz" (oldest).
+ */
+class LogArchive
+{
+public:
+    // Compresses the log file into the newest archive, shifting the older ones
+    // and removing those beyond maxArchives. The log file is read in chunks and left empty.
+    static bool rotate(const QString &logFilePath, int maxArchives);
+
+    static void removeArchives(const QString &logFilePath);
+
+    // Archives from the oldest to the newest, followed by the log file itself
+    static QStringList segments(const QString &logFilePath);
+
+    // Writes all segments as plain text. Archives are decompressed and the log
+    // file copied in chunks, no segment is held in memory as a whole.
+    static bool exportTo(const QString &logFilePath, QIODevice &out);
+
+private:
+    static QString archivePath(const QString &logFilePath, int index);
+};
+
+#endif // LOGARCHIVE_H
@@ -6,11 +6,14 @@
 #include <QDir>
 #include <QJsonDocument>
 #include <QMetaEnum>
+#include <QRegularExpression>
 #include <QStandardPaths>
 #include <QUrl>
 
 #include <iostream>
 
+#include "logarchive.h"
+#include "logwriter.h"
 #include "utilities.h"
 #include "version.h"
 
@@ -24,9 +27,23 @@
 
 QFile Logger::m_file;
 QTextStream Logger::m_textStream;
+std::atomic<LogWriter *> Logger::m_writer = nullptr;
+QReadWriteLock Logger::m_writerLock;
+// Android keeps debug records for logcat, where they are collected without init()
+#if defined(QT_DEBUG) || defined(Q_OS_ANDROID)
+std::atomic<int> Logger::m_minLogLevel = LogLevel::Debug;
+#else
+std::atomic<int> Logger::m_minLogLevel = LogLevel::Info;
+#endif
 QString Logger::m_logFileName = QString("%1.log").arg(APPLICATION_NAME);
 QString Logger::m_serviceLogFileName = QString("%1.log").arg(SERVICE_NAME);
 
+namespace {
+    constexpr qint64 maxLogFileSize = 10 * 1024 * 1024;
+    constexpr qint64 maxLogFileAgeSecs = 7 * 24 * 60 * 60;
+    constexpr int maxLogArchives = 5;
+}
+
 void debugMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
     if (msg.simplified().isEmpty()) {
@@ -43,9 +60,23 @@ void debugMessageHandler(QtMsgType type, const QMessageLogContext &context, cons
         return;
     }
 
-    Logger::m_textStream << qFormatLogMessage(type, context, msg) << Qt::endl << Qt::flush;
+    QByteArray record = qFormatLogMessage(type, context, msg).toUtf8();
+    record.append('\n');
+
+    // File and console output happen on the writer thread, only errors may wait for it
+    {
+        QReadLocker locker(&Logger::m_writerLock);
+        if (LogWriter *writer = Logger::m_writer.load()) {
+            writer->push(std::move(record),
+                         type == QtCriticalMsg || type == QtFatalMsg ? LogWriter::Overflow::Block : LogWriter::Overflow::Drop);
+            if (type == QtFatalMsg) {
+                writer->flush();
+            }
+            return;
+        }
+    }
 
-    std::cout << qFormatLogMessage(type, context, msg).toStdString() << std::endl << std::flush;
+    std::cout << record.constData() << std::flush;
 }
 
 Logger &Logger::Instance()
@@ -63,15 +94,31 @@ bool Logger::init(bool isServiceLogger)
         return false;
     }
 
-    m_file.setFileName(appDir.filePath(logFileName));
-    if (!m_file.open(QIODevice::Append)) {
+    bool isOpened;
+    {
+        // Deleting the old writer joins its thread, after that nothing else uses the file
+        QWriteLocker locker(&m_writerLock);
+        delete m_writer.exchange(nullptr);
+        m_textStream.setDevice(nullptr);
+        m_file.close();
+
+        m_file.setFileName(appDir.filePath(logFileName));
+        isOpened = m_file.open(QIODevice::Append);
+        if (isOpened) {
+            m_file.setTextModeEnabled(true);
+            m_textStream.setDevice(&m_file);
+            m_writer = new LogWriter(&m_file, true, { maxLogFileSize, maxLogFileAgeSecs, maxLogArchives });
+        }
+    }
+
+    if (!isOpened) {
         qWarning() << "Cannot open log file:" << logFileName;
         return false;
     }
 
-    m_file.setTextModeEnabled(true);
-    m_textStream.setDevice(&m_file);
-    qSetMessagePattern("%{time yyyy-MM-dd hh:mm:ss} %{type} %{message}");
+    setLogLevel(LogLevel::Debug);
+    // time, level, thread, category (when not "default"), message and key=value fields
+    qSetMessagePattern("%{time yyyy-MM-dd hh:mm:ss.zzz} %{type} [%{threadid}] %{if-category}%{category}: %{endif}%{message}");
 
 #if !defined(QT_DEBUG) || defined(Q_OS_IOS)
     qInstallMessageHandler(debugMessageHandler);
@@ -82,12 +129,29 @@ bool Logger::init(bool isServiceLogger)
 
 void Logger::deInit()
 {
+#ifndef QT_DEBUG
+    setLogLevel(LogLevel::Info);
+#endif
     qInstallMessageHandler(nullptr);
     qSetMessagePattern("%{message}");
+
+    // A handler that is still running keeps the writer until it releases the lock
+    QWriteLocker locker(&m_writerLock);
+    delete m_writer.exchange(nullptr);
     m_textStream.setDevice(nullptr);
     m_file.close();
 }
 
+void Logger::setLogLevel(LogLevel level)
+{
+    m_minLogLevel.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Logger::logLevel()
+{
+    return static_cast<LogLevel>(m_minLogLevel.load(std::memory_order_relaxed));
+}
+
 bool Logger::setServiceLogsEnabled(bool enabled)
 {
 #ifdef AMNEZIA_DESKTOP
@@ -142,9 +206,24 @@ QString Logger::serviceLogsFilePath()
     return systemLogDir() + QDir::separator() + m_serviceLogFileName;
 }
 
+void Logger::flushWriter()
+{
+    QReadLocker locker(&m_writerLock);
+    if (LogWriter *writer = m_writer.load()) {
+        writer->flush();
+    }
+}
+
+quint64 Logger::droppedLogLines()
+{
+    QReadLocker locker(&m_writerLock);
+    LogWriter *writer = m_writer.load();
+    return writer ? writer->droppedCount() : 0;
+}
+
 QString Logger::getLogFile()
 {
-    m_file.flush();
+    flushWriter();
     QFile file(userLogsFilePath());
 
     file.open(QIODevice::ReadOnly);
@@ -159,7 +238,7 @@ QString Logger::getLogFile()
 
 QString Logger::getServiceLogFile()
 {
-    m_file.flush();
+    flushWriter();
     QFile file(serviceLogsFilePath());
 
     file.open(QIODevice::ReadOnly);
@@ -172,6 +251,12 @@ QString Logger::getServiceLogFile()
 #endif
 }
 
+bool Logger::exportLogs(bool isServiceLogger, QIODevice &out)
+{
+    flushWriter();
+    return LogArchive::exportTo(isServiceLogger ? serviceLogsFilePath() : userLogsFilePath(), out);
+}
+
 bool Logger::openLogsFolder(bool isServiceLogger)
 {
     QString path = isServiceLogger ? systemLogDir() : userLogsDir();
@@ -187,14 +272,23 @@ bool Logger::openLogsFolder(bool isServiceLogger)
 
 void Logger::clearLogs(bool isServiceLogger)
 {
-    bool isLogActive = m_file.isOpen();
-    m_file.close();
+    // The writer thread closes and reopens m_file when it rotates the log, so whether
+    // logging is on is told by the writer, which only init() and deInit() replace
+    bool isLogActive;
+    {
+        QReadLocker locker(&m_writerLock);
+        isLogActive = m_writer.load() != nullptr;
+    }
+    if (isLogActive) {
+        deInit();
+    }
 
     QFile file(isServiceLogger ? serviceLogsFilePath() : userLogsFilePath());
 
     file.open(QIODevice::WriteOnly | QIODevice::Truncate);
     file.resize(0);
     file.close();
+    LogArchive::removeArchives(file.fileName());
 
 #ifdef Q_OS_IOS
     AmneziaVPN::swiftDeleteLog();
@@ -234,16 +328,52 @@ void Logger::cleanUp()
     clearLogs(true);
 }
 
-Logger::Log::Log(Logger *logger, LogLevel logLevel) : m_logger(logger), m_logLevel(logLevel), m_data(new Data())
+Logger::Log::Log(Logger *logger, LogLevel logLevel)
+    : m_logger(logger), m_logLevel(logLevel), m_data(logger->isEnabled(logLevel) ? new Data() : nullptr)
 {
 }
 
+Logger::Log::Log(Log &&other) noexcept : m_logger(other.m_logger), m_logLevel(other.m_logLevel), m_data(other.m_data)
+{
+    other.m_data = nullptr;
+}
+
 Logger::Log::~Log()
 {
-    qDebug() << "Amnezia" << m_logger->className() << m_data->m_buffer.trimmed();
+    if (!m_data) {
+        return;
+    }
+
+    QMessageLogger messageLogger;
+    QDebug out = [&]() {
+        switch (m_logLevel) {
+        case LogLevel::Trace:
+        case LogLevel::Debug: return messageLogger.debug(m_logger->category());
+        case LogLevel::Info: return messageLogger.info(m_logger->category());
+        case LogLevel::Warning: return messageLogger.warning(m_logger->category());
+        default: return messageLogger.critical(m_logger->category());
+        }
+    }();
+    out.noquote().nospace() << m_data->m_buffer.trimmed() << m_data->m_fields;
     delete m_data;
 }
 
+void Logger::Log::addField(const char *key, const QString &value)
+{
+    // Values with separators are quoted so that the record stays parseable
+    static const QRegularExpression needsQuotes("[\\s=\"]");
+    m_data->m_fields += ' ';
+    m_data->m_fields += QLatin1String(key);
+    m_data->m_fields += '=';
+    if (value.isEmpty() || value.contains(needsQuotes)) {
+        QString escaped = value;
+        escaped.replace('\\', "\\\\").replace('"', "\\\"");
+        m_data->m_fields += '"' + escaped + '"';
+    } else {
+        m_data->m_fields += value;
+    }
+}
+
 Logger::Log Logger::error()
 {
     return Log(this, LogLevel::Error);
@@ -273,7 +403,9 @@ QString Logger::sensitive(const QString &input)
 #define CREATE_LOG_OP_REF(x)                                                                                                               \
     Logger::Log &Logger::Log::operator<<(x t)                                                                                              \
     {                                                                                                                                      \
-        m_data->m_ts << t << ' ';                                                                                                          \
+        if (m_data) {                                                                                                                      \
+            m_data->m_ts << t << ' ';                                                                                                      \
+        }                                                                                                                                  \
         return *this;                                                                                                                      \
     }
 
@@ -287,24 +419,37 @@ CREATE_LOG_OP_REF(const void *);
 
 Logger::Log &Logger::Log::operator<<(const QStringList &t)
 {
+    if (!m_data) {
+        return *this;
+    }
     m_data->m_ts << '[' << t.join(",") << ']' << ' ';
     return *this;
 }
 
 Logger::Log &Logger::Log::operator<<(const QJsonObject &t)
 {
+    if (!m_data) {
+        return *this;
+    }
     m_data->m_ts << QJsonDocument(t).toJson(QJsonDocument::Indented) << ' ';
     return *this;
 }
 
 Logger::Log &Logger::Log::operator<<(QTextStreamFunction t)
 {
+    if (!m_data) {
+        return *this;
+    }
     m_data->m_ts << t;
     return *this;
 }
 
 void Logger::Log::addMetaEnum(quint64 value, const QMetaObject *meta, const char *name)
 {
+    if (!m_data) {
+        return;
+    }
+
     QMetaEnum me = meta->enumerator(meta->indexOfEnumerator(name));
 
     QString out;
@@ -4,11 +4,24 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QLoggingCategory>
+#include <QReadWriteLock>
 #include <QString>
 #include <QTextStream>
 
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
 #include "mozilla/shared/loglevel.h"
 
+// Records below this level are compiled out of Logger::isEnabled() checks
+#ifndef AMNEZIA_LOG_MIN_LEVEL
+    #define AMNEZIA_LOG_MIN_LEVEL LogLevel::Trace
+#endif
+
+class LogWriter;
+
 class Logger : public QObject
 {
     Q_OBJECT
@@ -34,22 +47,69 @@ public:
     static QString getLogFile();
     static QString getServiceLogFile();
 
+    // Number of lines the asynchronous writer had to drop since init()
+    static quint64 droppedLogLines();
+
+    // Writes the rotated archives and the current log as plain text
+    static bool exportLogs(bool isServiceLogger, QIODevice &out);
+
+    // Records below the level are dropped before they are formatted. It is Debug while
+    // logs are saved and Info otherwise; categories can be tuned with QT_LOGGING_RULES,
+    // e.g. "amnezia.Daemon.debug=false".
+    static void setLogLevel(LogLevel level);
+    static LogLevel logLevel();
+
     // compat with Mozilla logger
     Logger(const QString &className)
+        : m_className(className), m_categoryName("amnezia." + className.toUtf8()), m_category(m_categoryName.constData())
     {
-        m_className = className;
     }
     const QString &className() const
     {
         return m_className;
     }
 
+    bool isEnabled(LogLevel level) const
+    {
+        if (level < AMNEZIA_LOG_MIN_LEVEL || level < m_minLogLevel.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        switch (level) {
+        case LogLevel::Trace:
+        case LogLevel::Debug: return m_category.isDebugEnabled();
+        case LogLevel::Info: return m_category.isInfoEnabled();
+        case LogLevel::Warning: return m_category.isWarningEnabled();
+        default: return m_category.isCriticalEnabled();
+        }
+    }
+
+    const QLoggingCategory &category() const
+    {
+        return m_category;
+    }
+
     class Log
     {
     public:
         Log(Logger *logger, LogLevel level);
+        Log(Log &&other) noexcept;
         ~Log();
 
+        bool isEnabled() const
+        {
+            return m_data != nullptr;
+        }
+
+        // Structured key=value field, written after the message. The value is only
+        // formatted when the record is enabled.
+        template<typename T> Log &field(const char *key, const T &value)
+        {
+            if (m_data) {
+                addField(key, fieldText(value));
+            }
+            return *this;
+        }
+
         Log &operator<<(uint64_t t);
         Log &operator<<(const char *t);
         Log &operator<<(const QString &t);
@@ -70,6 +130,26 @@ public:
 
     private:
         void addMetaEnum(quint64 value, const QMetaObject *meta, const char *name);
+        void addField(const char *key, const QString &value);
+
+        template<typename T, typename = void> struct HasToString : std::false_type
+        {
+        };
+        template<typename T>
+        struct HasToString<T, std::void_t<decltype(std::declval<const T &>().toString())>> : std::true_type
+        {
+        };
+
+        template<typename T> static QString fieldText(const T &value)
+        {
+            if constexpr (HasToString<T>::value) {
+                return value.toString();
+            } else {
+                QString text;
+                QDebug(&text).noquote().nospace() << value;
+                return text;
+            }
+        }
 
         Logger *m_logger;
         LogLevel m_logLevel;
@@ -82,6 +162,7 @@ public:
 
             QString m_buffer;
             QTextStream m_ts;
+            QString m_fields;
         };
 
         Data *m_data;
@@ -94,14 +175,20 @@ public:
     QString sensitive(const QString &input);
 
 private:
-    Logger() {};
+    Logger() : m_categoryName("amnezia"), m_category(m_categoryName.constData()) {};
     Logger(Logger const &) = delete;
     Logger &operator=(Logger const &) = delete;
 
     static QString userLogsDir();
+    static void flushWriter();
 
     static QFile m_file;
     static QTextStream m_textStream;
+    // The message handler holds the lock for reading while it uses the writer,
+    // init() and deInit() replace the writer and the file with the lock held for writing
+    static std::atomic<LogWriter *> m_writer;
+    static QReadWriteLock m_writerLock;
+    static std::atomic<int> m_minLogLevel;
     static QString m_logFileName;
     static QString m_serviceLogFileName;
 
@@ -109,6 +196,8 @@ private:
 
     // compat with Mozilla logger
     QString m_className;
+    QByteArray m_categoryName;
+    QLoggingCategory m_category;
 };
 
 #endif // LOGGER_H
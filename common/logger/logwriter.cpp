@@ -0,0 +1,209 @@
+#include "logwriter.h"
+
+#include <QFileInfo>
+
+#include "logarchive.h"
+
+#include <chrono>
+#include <iostream>
+
+namespace {
+    constexpr auto idleWakeup = std::chrono::milliseconds(100);
+
+    quint64 roundUpToPowerOfTwo(quint64 value)
+    {
+        quint64 result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+LogWriter::LogWriter(QFile *file, bool echoToStdout, const Rotation &rotation, int capacity)
+    : m_file(file), m_echoToStdout(echoToStdout), m_rotation(rotation)
+{
+    if (m_file) {
+        m_segmentStarted = QFileInfo(m_file->fileName()).birthTime();
+    }
+    if (!m_segmentStarted.isValid()) {
+        m_segmentStarted = QDateTime::currentDateTime();
+    }
+
+    const quint64 size = roundUpToPowerOfTwo(qMax(capacity, 2));
+    m_slots.reset(new Slot[size]);
+    m_mask = size - 1;
+    for (quint64 i = 0; i < size; ++i) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    m_thread = std::thread([this]() { run(); });
+}
+
+LogWriter::~LogWriter()
+{
+    m_stop.store(true);
+    wakeWriter();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool LogWriter::push(QByteArray &&record, Overflow overflow)
+{
+    while (!tryPush(record)) {
+        if (overflow == Overflow::Drop || m_stop.load(std::memory_order_relaxed)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        wakeWriter();
+        std::this_thread::yield();
+    }
+
+    if (m_writerWaiting.load()) {
+        wakeWriter();
+    }
+    return true;
+}
+
+void LogWriter::flush()
+{
+    if (std::this_thread::get_id() == m_thread.get_id()) {
+        return;
+    }
+
+    const quint64 target = m_enqueuePos.load();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_writerCv.notify_one();
+    m_flushCv.wait(lock, [this, target]() { return m_writtenPos.load() >= target || m_stop.load(); });
+}
+
+// Bounded MPMC queue by Dmitry Vyukov, used with a single consumer: every slot
+// carries a sequence number telling whether it is free for the producer at that
+// position or holds a record for the consumer
+bool LogWriter::tryPush(QByteArray &record)
+{
+    quint64 pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &m_slots[pos & m_mask];
+        const quint64 sequence = slot->sequence.load(std::memory_order_acquire);
+        const qint64 diff = static_cast<qint64>(sequence - pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->record = std::move(record);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool LogWriter::tryPop(QByteArray &record)
+{
+    Slot &slot = m_slots[m_dequeuePos & m_mask];
+    const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+    if (static_cast<qint64>(sequence - (m_dequeuePos + 1)) < 0) {
+        return false;
+    }
+
+    record = std::move(slot.record);
+    slot.record = QByteArray();
+    slot.sequence.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+    m_dequeuePos++;
+    return true;
+}
+
+bool LogWriter::hasPending() const
+{
+    const Slot &slot = m_slots[m_dequeuePos & m_mask];
+    return static_cast<qint64>(slot.sequence.load(std::memory_order_acquire) - (m_dequeuePos + 1)) >= 0;
+}
+
+void LogWriter::wakeWriter()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writerCv.notify_one();
+}
+
+void LogWriter::run()
+{
+    QByteArray batch;
+    QByteArray record;
+
+    for (;;) {
+        int count = 0;
+        while (count < MAX_BATCH_RECORDS && tryPop(record)) {
+            batch.append(record);
+            count++;
+        }
+
+        const quint64 dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_reportedDropped) {
+            batch.append(QByteArray("Logger: dropped ") + QByteArray::number(dropped - m_reportedDropped)
+                         + " lines, log buffer is full\n");
+            m_reportedDropped = dropped;
+        }
+
+        if (!batch.isEmpty()) {
+            write(batch);
+            batch.truncate(0);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_writtenPos.store(m_dequeuePos);
+            m_flushCv.notify_all();
+
+            if (count == MAX_BATCH_RECORDS) {
+                continue;
+            }
+            if (m_stop.load() && !hasPending()) {
+                break;
+            }
+
+            m_writerWaiting.store(true);
+            m_writerCv.wait_for(lock, idleWakeup, [this]() { return m_stop.load() || hasPending(); });
+            m_writerWaiting.store(false);
+        }
+    }
+}
+
+void LogWriter::write(const QByteArray &batch)
+{
+    if (m_file && m_file->isOpen()) {
+        m_file->write(batch);
+        m_file->flush();
+        rotateIfNeeded();
+    }
+
+    if (m_echoToStdout) {
+        std::cout.write(batch.constData(), batch.size());
+        std::cout.flush();
+    }
+}
+
+void LogWriter::rotateIfNeeded()
+{
+    const bool tooBig = m_rotation.maxSize > 0 && m_file->size() >= m_rotation.maxSize;
+    const bool tooOld = m_rotation.maxAgeSecs > 0 && m_segmentStarted.secsTo(QDateTime::currentDateTime()) >= m_rotation.maxAgeSecs;
+    if (!tooBig && !tooOld) {
+        return;
+    }
+
+    const QIODevice::OpenMode mode = m_file->openMode();
+    m_file->close();
+    if (!LogArchive::rotate(m_file->fileName(), m_rotation.maxArchives)) {
+        // Keep appending rather than retrying on every batch
+        std::cerr << "Logger: failed to rotate " << m_file->fileName().toStdString() << ", rotation disabled" << std::endl;
+        m_rotation = Rotation();
+    }
+    m_file->open(mode);
+    m_segmentStarted = QDateTime::currentDateTime();
+}
@@ -0,0 +1,91 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief The LogWriter class - Asynchronous sink for preformatted log records
+ *
+ * Records are pushed from any thread into a bounded lock-free ring buffer
+ * and written in batches by a dedicated thread, so callers never wait for
+ * file or console I/O. When the buffer is full, records pushed with
+ * Overflow::Drop are discarded and counted, records pushed with
+ * Overflow::Block wait for free space.
+ *
+ * The writer thread also rotates the file into gzip archives (see LogArchive)
+ * once it grows over Rotation::maxSize or gets older than Rotation::maxAgeSecs.
+ */
+class LogWriter
+{
+public:
+    enum class Overflow {
+        Drop,
+        Block
+    };
+
+    struct Rotation
+    {
+        qint64 maxSize = 0; // bytes, 0 disables size based rotation
+        qint64 maxAgeSecs = 0; // 0 disables age based rotation
+        int maxArchives = 0;
+    };
+
+    static constexpr int DEFAULT_CAPACITY = 8192;
+
+    LogWriter(QFile *file, bool echoToStdout, const Rotation &rotation = Rotation(), int capacity = DEFAULT_CAPACITY);
+    ~LogWriter();
+
+    bool push(QByteArray &&record, Overflow overflow);
+
+    // Waits until everything pushed before the call is written to the device
+    void flush();
+
+    quint64 droppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot
+    {
+        std::atomic<quint64> sequence;
+        QByteArray record;
+    };
+
+    static constexpr int MAX_BATCH_RECORDS = 256;
+
+    bool tryPush(QByteArray &record);
+    bool tryPop(QByteArray &record);
+    bool hasPending() const;
+    void wakeWriter();
+    void run();
+    void write(const QByteArray &batch);
+    void rotateIfNeeded();
+
+    QFile *m_file;
+    bool m_echoToStdout;
+    Rotation m_rotation;
+    QDateTime m_segmentStarted; // writer thread only
+
+    std::unique_ptr<Slot[]> m_slots;
+    quint64 m_mask;
+    std::atomic<quint64> m_enqueuePos { 0 };
+    quint64 m_dequeuePos = 0; // writer thread only
+    std::atomic<quint64> m_writtenPos { 0 };
+    std::atomic<quint64> m_dropped { 0 };
+    quint64 m_reportedDropped = 0; // writer thread only
+
+    std::mutex m_mutex;
+    std::condition_variable m_writerCv;
+    std::condition_variable m_flushCv;
+    std::atomic<bool> m_writerWaiting { false };
+    std::atomic<bool> m_stop { false };
+    std::thread m_thread;
+};
+
+#endif // LOGWRITER_H
@@ -40,12 +40,9 @@ inline QString getIpcServiceUrl() {
 #endif
 }
 
-inline QString getIpcProcessUrl(int pid) {
-#ifdef Q_OS_WIN
-    return QString("%1_%2").arg(IPC_SERVICE_URL).arg(pid);
-#else
-    return QString("/tmp/%1_%2").arg(IPC_SERVICE_URL).arg(pid);
-#endif
+// Privileged processes are remoted on the service host under this name
+inline QString getIpcProcessName(int pid) {
+    return QString("IpcProcessInterface_%1").arg(pid);
 }
 
 
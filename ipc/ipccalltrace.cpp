@@ -0,0 +1,163 @@
+#include "ipccalltrace.h"
+
+#include <algorithm>
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QMutexLocker>
+
+namespace
+{
+    constexpr char slowCallThresholdEnv[] = "AMNEZIA_IPC_SLOW_CALL_MSEC";
+}
+
+IpcCallTrace::Scope::Scope(const char *slot, qint64 payloadBytes) : m_slot(slot), m_payloadBytes(payloadBytes)
+{
+    m_timer.start();
+}
+
+IpcCallTrace::Scope::~Scope()
+{
+    IpcCallTrace::instance()->record(QString::fromLatin1(m_slot), m_timer.nsecsElapsed() / 1000, m_payloadBytes);
+}
+
+IpcCallTrace *IpcCallTrace::instance()
+{
+    static IpcCallTrace *trace = []() {
+        auto trace = new IpcCallTrace();
+        bool ok = false;
+        int threshold = qEnvironmentVariableIntValue(slowCallThresholdEnv, &ok);
+        if (ok && threshold > 0) {
+            trace->m_slowCallThresholdMsec = threshold;
+        }
+        return trace;
+    }();
+    return trace;
+}
+
+void IpcCallTrace::record(const QString &slot, qint64 usec, qint64 payloadBytes)
+{
+    bool slow = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        SlotStats &stats = m_slots[slot];
+        stats.calls++;
+        stats.totalUsec += usec;
+        stats.maxUsec = std::max(stats.maxUsec, usec);
+        stats.totalPayload += payloadBytes;
+        stats.maxPayload = std::max(stats.maxPayload, payloadBytes);
+
+        int bucket = 0;
+        while (bucket < BUCKET_COUNT - 1 && usec > BUCKET_BOUNDS_MSEC[bucket] * 1000) {
+            bucket++;
+        }
+        stats.buckets[bucket]++;
+
+        slow = usec > m_slowCallThresholdMsec * 1000ll;
+        if (slow) {
+            stats.slowCalls++;
+        }
+    }
+
+    if (slow) {
+        qWarning().noquote() << QString("IPC call %1 took %2 ms, payload %3 bytes").arg(slot).arg(usec / 1000).arg(payloadBytes);
+    }
+}
+
+int IpcCallTrace::slowCallThresholdMsec() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_slowCallThresholdMsec;
+}
+
+void IpcCallTrace::setSlowCallThresholdMsec(int msec)
+{
+    QMutexLocker locker(&m_mutex);
+    m_slowCallThresholdMsec = msec;
+}
+
+QJsonObject IpcCallTrace::toJson() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QJsonArray bounds;
+    for (int bound : BUCKET_BOUNDS_MSEC) {
+        bounds.append(bound);
+    }
+
+    QJsonObject slotStats;
+    for (auto it = m_slots.constBegin(); it != m_slots.constEnd(); ++it) {
+        const SlotStats &stats = it.value();
+
+        QJsonArray buckets;
+        for (quint64 count : stats.buckets) {
+            buckets.append(static_cast<qint64>(count));
+        }
+
+        QJsonObject obj;
+        obj.insert("calls", static_cast<qint64>(stats.calls));
+        obj.insert("avgUsec", stats.calls ? stats.totalUsec / static_cast<qint64>(stats.calls) : 0);
+        obj.insert("maxUsec", stats.maxUsec);
+        obj.insert("totalUsec", stats.totalUsec);
+        obj.insert("avgPayload", stats.calls ? stats.totalPayload / static_cast<qint64>(stats.calls) : 0);
+        obj.insert("maxPayload", stats.maxPayload);
+        obj.insert("slowCalls", static_cast<qint64>(stats.slowCalls));
+        obj.insert("histogram", buckets);
+        slotStats.insert(it.key(), obj);
+    }
+
+    QJsonObject json;
+    json.insert("bucketBoundsMsec", bounds);
+    json.insert("slowCallThresholdMsec", m_slowCallThresholdMsec);
+    json.insert("slots", slotStats);
+    return json;
+}
+
+QString IpcCallTrace::report() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Slots that took most of the time go first
+    QList<QString> names = m_slots.keys();
+    std::sort(names.begin(), names.end(),
+              [this](const QString &a, const QString &b) { return m_slots.value(a).totalUsec > m_slots.value(b).totalUsec; });
+
+    QString header = "slot calls avg_ms max_ms total_ms avg_bytes max_bytes slow |";
+    for (int bound : BUCKET_BOUNDS_MSEC) {
+        header += QString(" <=%1").arg(bound);
+    }
+    header += " more";
+
+    QStringList lines { header };
+    for (const QString &name : names) {
+        const SlotStats stats = m_slots.value(name);
+        QString line = QString("%1 %2 %3 %4 %5 %6 %7 %8 |")
+                               .arg(name)
+                               .arg(stats.calls)
+                               .arg(stats.totalUsec / 1000.0 / stats.calls, 0, 'f', 2)
+                               .arg(stats.maxUsec / 1000.0, 0, 'f', 2)
+                               .arg(stats.totalUsec / 1000.0, 0, 'f', 2)
+                               .arg(stats.totalPayload / static_cast<qint64>(stats.calls))
+                               .arg(stats.maxPayload)
+                               .arg(stats.slowCalls);
+        for (quint64 count : stats.buckets) {
+            line += QString(" %1").arg(count);
+        }
+        lines.append(line);
+    }
+    return lines.join('\n');
+}
+
+void IpcCallTrace::dump() const
+{
+    const QString text = report();
+    for (const QString &line : text.split('\n')) {
+        qInfo().noquote() << "IPC trace:" << line;
+    }
+}
+
+void IpcCallTrace::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_slots.clear();
+}
@@ -0,0 +1,95 @@
+#ifndef IPCCALLTRACE_H
+#define IPCCALLTRACE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+// Collects per-slot latency histograms and payload sizes of the QtRemoteObjects
+// calls between the client and the service. The client side records the round trip
+// of a pending reply, the service side records the time spent in the source slot.
+class IpcCallTrace
+{
+public:
+    class Scope
+    {
+    public:
+        explicit Scope(const char *slot, qint64 payloadBytes = 0);
+        ~Scope();
+
+    private:
+        const char *m_slot;
+        qint64 m_payloadBytes;
+        QElapsedTimer m_timer;
+    };
+
+    static IpcCallTrace *instance();
+
+    void record(const QString &slot, qint64 usec, qint64 payloadBytes);
+
+    int slowCallThresholdMsec() const;
+    void setSlowCallThresholdMsec(int msec);
+
+    QJsonObject toJson() const;
+    QString report() const;
+    void dump() const;
+    void reset();
+
+    // Estimated size of the arguments as QtRemoteObjects serializes them on the wire.
+    // Only lengths and counts are read, the arguments are not serialized.
+    template <typename... Args> static qint64 payloadSize(const Args &...args)
+    {
+        return (qint64(0) + ... + estimatedSize(args));
+    }
+
+private:
+    // Serialized containers and strings carry a 32 bit length before the data
+    static constexpr qint64 LENGTH_PREFIX = 4;
+    // Rough size of one member of a JSON object in its serialized text
+    static constexpr qint64 JSON_MEMBER_ESTIMATE = 32;
+
+    static qint64 estimatedSize(const QString &value) { return LENGTH_PREFIX + value.size() * 2; }
+    static qint64 estimatedSize(const QByteArray &value) { return LENGTH_PREFIX + value.size(); }
+    static qint64 estimatedSize(const QJsonObject &value) { return LENGTH_PREFIX + value.size() * JSON_MEMBER_ESTIMATE; }
+    static qint64 estimatedSize(const QHostAddress &) { return 1 + 16; }
+    template <typename T> static qint64 estimatedSize(const QList<T> &values)
+    {
+        qint64 size = LENGTH_PREFIX;
+        for (const T &value : values) {
+            size += estimatedSize(value);
+        }
+        return size;
+    }
+    template <typename T> static qint64 estimatedSize(const T &)
+    {
+        return sizeof(T);
+    }
+
+    IpcCallTrace() = default;
+
+    // Upper bounds of the histogram buckets, the last bucket has no bound
+    static constexpr int BUCKET_BOUNDS_MSEC[] = { 1, 5, 10, 50, 100, 500, 1000, 5000 };
+    static constexpr int BUCKET_COUNT = sizeof(BUCKET_BOUNDS_MSEC) / sizeof(int) + 1;
+
+    struct SlotStats
+    {
+        quint64 calls = 0;
+        qint64 totalUsec = 0;
+        qint64 maxUsec = 0;
+        qint64 totalPayload = 0;
+        qint64 maxPayload = 0;
+        quint64 slowCalls = 0;
+        quint64 buckets[BUCKET_COUNT] = {};
+    };
+
+    mutable QMutex m_mutex;
+    QHash<QString, SlotStats> m_slots;
+    int m_slowCallThresholdMsec = 1000;
+};
+
+#endif // IPCCALLTRACE_H
@@ -1,10 +1,14 @@
 #include "ipcserver.h"
 
+#include <functional>
+
 #include <QDateTime>
 #include <QFileInfo>
+#include <QJsonArray>
 #include <QLocalSocket>
 #include <QObject>
 
+#include "ipccalltrace.h"
 #include "logger.h"
 #include "router.h"
 
@@ -24,13 +28,36 @@
     #include "../client/platforms/macos/daemon/macosfirewall.h"
 #endif
 
+namespace {
+    // Whether firewall rules are in place, set up through IpcServer or by the daemon
+    bool killSwitchActive()
+    {
+#ifdef Q_OS_WIN
+        return WindowsFirewall::instance()->isKillSwitchEnabled();
+#elif defined(Q_OS_LINUX)
+        return LinuxFirewall::isInstalled();
+#elif defined(Q_OS_MACOS)
+        return MacOSFirewall::isInstalled();
+#else
+        return false;
+#endif
+    }
+}
+
 IpcServer::IpcServer(QObject *parent) : IpcInterfaceSource(parent)
 
 {
 }
 
+void IpcServer::setRemoteObjectHost(QRemoteObjectHost *host)
+{
+    m_host = host;
+}
+
 int IpcServer::createPrivilegedProcess()
 {
+    IpcCallTrace::Scope trace("createPrivilegedProcess");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::createPrivilegedProcess";
 #endif
@@ -39,38 +66,30 @@ int IpcServer::createPrivilegedProcess()
     WindowsFirewall::instance()->init();
 #endif
 
-    m_localpid++;
-
-    ProcessDescriptor pd(this);
-
-    pd.localServer->setSocketOptions(QLocalServer::WorldAccessOption);
-
-    if (!pd.localServer->listen(amnezia::getIpcProcessUrl(m_localpid))) {
-        qDebug() << QString("Unable to start the server: %1.").arg(pd.localServer->errorString());
+    if (!m_host) {
+        qWarning() << "IpcServer::createPrivilegedProcess: no remote object host";
         return -1;
     }
 
-    // Make sure any connections are handed to QtRO
-    QObject::connect(pd.localServer.data(), &QLocalServer::newConnection, this, [pd]() {
-        qDebug() << "IpcServer new connection";
-        if (pd.serverNode) {
-            pd.serverNode->addHostSideConnection(pd.localServer->nextPendingConnection());
-            pd.serverNode->enableRemoting(pd.ipcProcess.data());
-        }
-    });
-
-    QObject::connect(pd.serverNode.data(), &QRemoteObjectHost::error, this,
-                     [pd](QRemoteObjectNode::ErrorCode errorCode) { qDebug() << "QRemoteObjectHost::error" << errorCode; });
+    m_localpid++;
 
-    QObject::connect(pd.serverNode.data(), &QRemoteObjectHost::destroyed, this, [pd]() { qDebug() << "QRemoteObjectHost::destroyed"; });
+    // The process is remoted on the host the client is already connected to,
+    // so no extra socket and node are needed per process
+    QSharedPointer<IpcServerProcess> process(new IpcServerProcess(this));
+    if (!m_host->enableRemoting(process.data(), amnezia::getIpcProcessName(m_localpid))) {
+        qWarning() << "Unable to remote the privileged process" << m_localpid << m_host->lastError();
+        return -1;
+    }
 
-    m_processes.insert(m_localpid, pd);
+    m_processes.insert(m_localpid, process);
 
     return m_localpid;
 }
 
 int IpcServer::routeAddList(const QString &gw, const QStringList &ips)
 {
+    IpcCallTrace::Scope trace("routeAddList", IpcCallTrace::payloadSize(gw, ips));
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::routeAddList";
 #endif
@@ -80,6 +99,8 @@ int IpcServer::routeAddList(const QString &gw, const QStringList &ips)
 
 bool IpcServer::clearSavedRoutes()
 {
+    IpcCallTrace::Scope trace("clearSavedRoutes");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::clearSavedRoutes";
 #endif
@@ -89,6 +110,8 @@ bool IpcServer::clearSavedRoutes()
 
 bool IpcServer::routeDeleteList(const QString &gw, const QStringList &ips)
 {
+    IpcCallTrace::Scope trace("routeDeleteList", IpcCallTrace::payloadSize(gw, ips));
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::routeDeleteList";
 #endif
@@ -96,8 +119,32 @@ bool IpcServer::routeDeleteList(const QString &gw, const QStringList &ips)
     return Router::routeDeleteList(gw, ips);
 }
 
+int IpcServer::routeAddPrefixes(const QString &gw, const QByteArray &prefixes)
+{
+    IpcCallTrace::Scope trace("routeAddPrefixes", IpcCallTrace::payloadSize(gw, prefixes));
+
+#ifdef MZ_DEBUG
+    qDebug() << "IpcServer::routeAddPrefixes";
+#endif
+
+    return Router::routeAddPrefixes(gw, prefixes);
+}
+
+int IpcServer::routeDeletePrefixes(const QString &gw, const QByteArray &prefixes)
+{
+    IpcCallTrace::Scope trace("routeDeletePrefixes", IpcCallTrace::payloadSize(gw, prefixes));
+
+#ifdef MZ_DEBUG
+    qDebug() << "IpcServer::routeDeletePrefixes";
+#endif
+
+    return Router::routeDeletePrefixes(gw, prefixes);
+}
+
 void IpcServer::flushDns()
 {
+    IpcCallTrace::Scope trace("flushDns");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::flushDns";
 #endif
@@ -107,6 +154,8 @@ void IpcServer::flushDns()
 
 void IpcServer::resetIpStack()
 {
+    IpcCallTrace::Scope trace("resetIpStack");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::resetIpStack";
 #endif
@@ -116,6 +165,8 @@ void IpcServer::resetIpStack()
 
 bool IpcServer::checkAndInstallDriver()
 {
+    IpcCallTrace::Scope trace("checkAndInstallDriver");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::checkAndInstallDriver";
 #endif
@@ -129,6 +180,8 @@ bool IpcServer::checkAndInstallDriver()
 
 QStringList IpcServer::getTapList()
 {
+    IpcCallTrace::Scope trace("getTapList");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::getTapList";
 #endif
@@ -142,6 +195,8 @@ QStringList IpcServer::getTapList()
 
 void IpcServer::cleanUp()
 {
+    IpcCallTrace::Scope trace("cleanUp");
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::cleanUp";
 #endif
@@ -152,35 +207,172 @@ void IpcServer::cleanUp()
 
 void IpcServer::clearLogs()
 {
+    IpcCallTrace::Scope trace("clearLogs");
+
     Logger::clearLogs(true);
 }
 
 bool IpcServer::createTun(const QString &dev, const QString &subnet)
 {
+    IpcCallTrace::Scope trace("createTun", IpcCallTrace::payloadSize(dev, subnet));
+
     return Router::createTun(dev, subnet);
 }
 
 bool IpcServer::deleteTun(const QString &dev)
 {
+    IpcCallTrace::Scope trace("deleteTun", IpcCallTrace::payloadSize(dev));
+
     return Router::deleteTun(dev);
 }
 
 bool IpcServer::updateResolvers(const QString &ifname, const QList<QHostAddress> &resolvers)
 {
+    IpcCallTrace::Scope trace("updateResolvers", IpcCallTrace::payloadSize(ifname, resolvers));
+
     return Router::updateResolvers(ifname, resolvers);
 }
 
+// Plan layout, every key is optional:
+//   resetIpStack: bool
+//   tun: { dev, subnet }
+//   resolvers: { ifname, servers: [address] }
+//   killSwitch: config passed to enableKillSwitch(), with vpnAdapterIndex
+//   deleteRoutes: [{ gateway, ips: [ip] }]
+//   routes: [{ gateway, ips: [ip], required: bool }]
+//   stopRoutingIpv6: bool
+//   flushDns: bool
+// Steps are applied in this order. Route sets are best effort unless they are
+// marked as required, like the separate routeAddList() calls.
+bool IpcServer::applyConnectionPlan(const QJsonObject &plan)
+{
+    IpcCallTrace::Scope trace("applyConnectionPlan", IpcCallTrace::payloadSize(plan));
+
+#ifdef MZ_DEBUG
+    qDebug() << "IpcServer::applyConnectionPlan";
+#endif
+
+    QList<std::function<void()>> rollback;
+    auto fail = [&rollback](const char *step) {
+        qWarning() << "IpcServer::applyConnectionPlan failed at" << step << ", rolling back";
+        while (!rollback.isEmpty()) {
+            rollback.takeLast()();
+        }
+        return false;
+    };
+    auto toStringList = [](const QJsonValue &value) {
+        QStringList list;
+        for (const QJsonValue &v : value.toArray()) {
+            list.append(v.toString());
+        }
+        return list;
+    };
+
+    if (plan.value("resetIpStack").toBool()) {
+        Router::resetIpStack();
+    }
+
+    const QJsonObject tun = plan.value("tun").toObject();
+    if (!tun.isEmpty()) {
+        const QString dev = tun.value("dev").toString();
+        if (!Router::createTun(dev, tun.value("subnet").toString())) {
+            return fail("tun");
+        }
+        rollback.append([dev]() { Router::deleteTun(dev); });
+    }
+
+    const QJsonObject resolvers = plan.value("resolvers").toObject();
+    if (!resolvers.isEmpty()) {
+        QList<QHostAddress> servers;
+        for (const QString &server : toStringList(resolvers.value("servers"))) {
+            QHostAddress address(server);
+            if (!address.isNull()) {
+                servers.append(address);
+            }
+        }
+        if (!Router::updateResolvers(resolvers.value("ifname").toString(), servers)) {
+            return fail("resolvers");
+        }
+        rollback.append([]() { Router::restoreResolvers(); });
+    }
+
+    if (plan.contains("killSwitch")) {
+        // A kill switch that was up before the plan is put back as it was, not removed
+        const bool wasActive = killSwitchActive();
+        const KillSwitch previous = m_killSwitch;
+        const QJsonObject killSwitch = plan.value("killSwitch").toObject();
+        if (!enableKillSwitch(killSwitch, killSwitch.value("vpnAdapterIndex").toInt())) {
+            return fail("killSwitch");
+        }
+        rollback.append([this, wasActive, previous]() {
+            if (!wasActive) {
+                disableKillSwitch();
+            } else if (previous.enabled) {
+                enableKillSwitch(previous.config, previous.vpnAdapterIndex);
+            } else {
+                qWarning() << "IpcServer::applyConnectionPlan keeps the kill switch, its previous rules are unknown";
+            }
+        });
+    }
+
+    // Only the routes this plan actually deleted or added are restored
+    for (const QJsonValue &value : plan.value("deleteRoutes").toArray()) {
+        const QJsonObject routes = value.toObject();
+        const QString gw = routes.value("gateway").toString();
+        QStringList deleted;
+        Router::routeDeleteList(gw, toStringList(routes.value("ips")), &deleted);
+        if (!deleted.isEmpty()) {
+            rollback.append([gw, deleted]() { Router::routeAddList(gw, deleted); });
+        }
+    }
+
+    for (const QJsonValue &value : plan.value("routes").toArray()) {
+        const QJsonObject routes = value.toObject();
+        const QString gw = routes.value("gateway").toString();
+        const QStringList ips = toStringList(routes.value("ips"));
+        QStringList added;
+        const int count = Router::routeAddList(gw, ips, &added);
+        if (!added.isEmpty()) {
+            rollback.append([gw, added]() { Router::routeDeleteList(gw, added); });
+        }
+        if (count != ips.size() && routes.value("required").toBool()) {
+            return fail("routes");
+        }
+    }
+
+    if (plan.value("stopRoutingIpv6").toBool()) {
+        Router::StopRoutingIpv6();
+    }
+
+    if (plan.value("flushDns").toBool()) {
+        Router::flushDns();
+    }
+
+    return true;
+}
+
+void IpcServer::dumpIpcTrace()
+{
+    IpcCallTrace::instance()->dump();
+}
+
 void IpcServer::StartRoutingIpv6()
 {
+    IpcCallTrace::Scope trace("StartRoutingIpv6");
+
     Router::StartRoutingIpv6();
 }
 void IpcServer::StopRoutingIpv6()
 {
+    IpcCallTrace::Scope trace("StopRoutingIpv6");
+
     Router::StopRoutingIpv6();
 }
 
 void IpcServer::setLogsEnabled(bool enabled)
 {
+    IpcCallTrace::Scope trace("setLogsEnabled", IpcCallTrace::payloadSize(enabled));
+
 #ifdef MZ_DEBUG
     qDebug() << "IpcServer::setLogsEnabled";
 #endif
@@ -194,8 +386,14 @@ void IpcServer::setLogsEnabled(bool enabled)
 
 bool IpcServer::enableKillSwitch(const QJsonObject &configStr, int vpnAdapterIndex)
 {
+    IpcCallTrace::Scope trace("enableKillSwitch", IpcCallTrace::payloadSize(configStr, vpnAdapterIndex));
+
 #ifdef Q_OS_WIN
-    return WindowsFirewall::instance()->enableKillSwitch(vpnAdapterIndex);
+    const bool enabled = WindowsFirewall::instance()->enableKillSwitch(vpnAdapterIndex);
+    if (enabled) {
+        m_killSwitch = { true, configStr, vpnAdapterIndex };
+    }
+    return enabled;
 #endif
 
 #if defined(Q_OS_LINUX) || defined(Q_OS_MACOS)
@@ -276,11 +474,16 @@ bool IpcServer::enableKillSwitch(const QJsonObject &configStr, int vpnAdapterInd
     MacOSFirewall::setAnchorTable(QStringLiteral("310.blockDNS"), true, QStringLiteral("dnsaddr"), dnsServers);
 #endif
 
+    m_killSwitch = { true, configStr, vpnAdapterIndex };
     return true;
 }
 
 bool IpcServer::disableKillSwitch()
 {
+    IpcCallTrace::Scope trace("disableKillSwitch");
+
+    m_killSwitch = KillSwitch();
+
 #ifdef Q_OS_WIN
     return WindowsFirewall::instance()->disableKillSwitch();
 #endif
@@ -298,6 +501,8 @@ bool IpcServer::disableKillSwitch()
 
 bool IpcServer::enablePeerTraffic(const QJsonObject &configStr)
 {
+    IpcCallTrace::Scope trace("enablePeerTraffic", IpcCallTrace::payloadSize(configStr));
+
 #ifdef Q_OS_WIN
     InterfaceConfig config;
     config.m_dnsServer = configStr.value(amnezia::config_key::dns1).toString();
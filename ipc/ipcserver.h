@@ -1,8 +1,8 @@
 #ifndef IPCSERVER_H
 #define IPCSERVER_H
 
-#include <QLocalServer>
 #include <QObject>
+#include <QPointer>
 #include <QRemoteObjectNode>
 #include <QJsonObject>
 #include "../client/daemon/interfaceconfig.h"
@@ -18,11 +18,17 @@ class IpcServer : public IpcInterfaceSource
 {
 public:
     explicit IpcServer(QObject *parent = nullptr);
+
+    // Host that privileged processes are remoted on, shared with the interface itself
+    void setRemoteObjectHost(QRemoteObjectHost *host);
+
     virtual int createPrivilegedProcess() override;
 
     virtual int routeAddList(const QString &gw, const QStringList &ips) override;
     virtual bool clearSavedRoutes() override;
     virtual bool routeDeleteList(const QString &gw, const QStringList &ips) override;
+    virtual int routeAddPrefixes(const QString &gw, const QByteArray &prefixes) override;
+    virtual int routeDeletePrefixes(const QString &gw, const QByteArray &prefixes) override;
     virtual void flushDns() override;
     virtual void resetIpStack() override;
     virtual bool checkAndInstallDriver() override;
@@ -38,25 +44,23 @@ public:
     virtual bool enableKillSwitch(const QJsonObject &excludeAddr, int vpnAdapterIndex) override;
     virtual bool disableKillSwitch() override;
     virtual bool updateResolvers(const QString& ifname, const QList<QHostAddress>& resolvers) override;
+    virtual bool applyConnectionPlan(const QJsonObject &plan) override;
+    virtual void dumpIpcTrace() override;
 
 private:
-    int m_localpid = 0;
-
-    struct ProcessDescriptor {
-        ProcessDescriptor (QObject *parent = nullptr) {
-            serverNode = QSharedPointer<QRemoteObjectHost>(new QRemoteObjectHost(parent));
-            ipcProcess = QSharedPointer<IpcServerProcess>(new IpcServerProcess(parent));
-            tun2socksProcess = QSharedPointer<IpcProcessTun2Socks>(new IpcProcessTun2Socks(parent));
-            localServer = QSharedPointer<QLocalServer>(new QLocalServer(parent));
-        }
-
-        QSharedPointer<IpcServerProcess> ipcProcess;
-        QSharedPointer<IpcProcessTun2Socks> tun2socksProcess;
-        QSharedPointer<QRemoteObjectHost> serverNode;
-        QSharedPointer<QLocalServer> localServer;
+    // Kill switch last enabled through this interface, restored when a plan rolls back
+    struct KillSwitch
+    {
+        bool enabled = false;
+        QJsonObject config;
+        int vpnAdapterIndex = 0;
     };
 
-    QMap<int, ProcessDescriptor> m_processes;
+    int m_localpid = 0;
+    KillSwitch m_killSwitch;
+
+    QPointer<QRemoteObjectHost> m_host;
+    QMap<int, QSharedPointer<IpcServerProcess>> m_processes;
 };
 
 #endif // IPCSERVER_H
@@ -0,0 +1,141 @@
+#ifndef ROUTEPREFIXES_H
+#define ROUTEPREFIXES_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QString>
+#include <QStringList>
+
+#include <cstring>
+
+namespace amnezia {
+
+// Route lists are sent to the service as packed binary prefixes instead of strings.
+// Every prefix takes ROUTE_PREFIX_SIZE bytes: address family (4 or 6), prefix length
+// and 16 address bytes in network order, IPv4 addresses use the first 4 of them.
+constexpr int ROUTE_PREFIX_SIZE = 18;
+
+// Number of prefixes sent in one IPC call
+constexpr int ROUTE_PREFIX_CHUNK = 4096;
+
+struct RoutePrefix
+{
+    quint8 family = 0;
+    quint8 length = 0;
+    quint8 address[16] = {};
+};
+
+inline bool parseIPv4Prefix(QStringView ip, RoutePrefix &prefix)
+{
+    quint32 octet = 0;
+    int octets = 0;
+    int digits = 0;
+    int length = 32;
+
+    for (qsizetype i = 0; i <= ip.size(); ++i) {
+        const QChar c = i < ip.size() ? ip.at(i) : QChar('.');
+        if (c.isDigit() && digits < 3) {
+            octet = octet * 10 + c.digitValue();
+            digits++;
+        } else if ((c == '.' || c == '/') && digits > 0 && octet <= 255 && octets < 4) {
+            prefix.address[octets++] = static_cast<quint8>(octet);
+            octet = 0;
+            digits = 0;
+            if (c == '/') {
+                bool ok = false;
+                length = ip.mid(i + 1).toInt(&ok);
+                if (!ok || length < 0 || length > 32) {
+                    return false;
+                }
+                break;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (octets != 4) {
+        return false;
+    }
+    prefix.family = 4;
+    prefix.length = static_cast<quint8>(length);
+    return true;
+}
+
+// Appends "address[/length]" to the buffer, returns false if it is not a valid prefix
+inline bool appendRoutePrefix(QByteArray &buffer, QStringView ipWithSubnet)
+{
+    RoutePrefix prefix;
+    if (!parseIPv4Prefix(ipWithSubnet, prefix)) {
+        const QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(ipWithSubnet.contains('/')
+                                                                                  ? ipWithSubnet.toString()
+                                                                                  : ipWithSubnet.toString() + "/128");
+        if (subnet.first.protocol() != QAbstractSocket::IPv6Protocol) {
+            return false;
+        }
+        const Q_IPV6ADDR address = subnet.first.toIPv6Address();
+        prefix.family = 6;
+        prefix.length = static_cast<quint8>(subnet.second);
+        std::memcpy(prefix.address, address.c, sizeof(prefix.address));
+    }
+
+    buffer.append(static_cast<char>(prefix.family));
+    buffer.append(static_cast<char>(prefix.length));
+    buffer.append(reinterpret_cast<const char *>(prefix.address), sizeof(prefix.address));
+    return true;
+}
+
+inline QByteArray routePrefixesFromStrings(const QStringList &ips)
+{
+    QByteArray buffer;
+    buffer.reserve(ips.size() * ROUTE_PREFIX_SIZE);
+    for (const QString &ip : ips) {
+        appendRoutePrefix(buffer, ip);
+    }
+    return buffer;
+}
+
+inline int routePrefixCount(const QByteArray &buffer)
+{
+    return buffer.size() / ROUTE_PREFIX_SIZE;
+}
+
+inline RoutePrefix routePrefixAt(const QByteArray &buffer, int index)
+{
+    const char *data = buffer.constData() + index * ROUTE_PREFIX_SIZE;
+    RoutePrefix prefix;
+    prefix.family = static_cast<quint8>(data[0]);
+    prefix.length = static_cast<quint8>(data[1]);
+    std::memcpy(prefix.address, data + 2, sizeof(prefix.address));
+    return prefix;
+}
+
+inline QString routePrefixToString(const RoutePrefix &prefix)
+{
+    QHostAddress address;
+    if (prefix.family == 4) {
+        address.setAddress(quint32(prefix.address[0]) << 24 | quint32(prefix.address[1]) << 16
+                           | quint32(prefix.address[2]) << 8 | quint32(prefix.address[3]));
+        if (prefix.length == 32) {
+            return address.toString();
+        }
+    } else {
+        address.setAddress(prefix.address);
+    }
+    return QString("%1/%2").arg(address.toString()).arg(prefix.length);
+}
+
+inline QStringList routePrefixesToStrings(const QByteArray &buffer)
+{
+    QStringList ips;
+    const int count = routePrefixCount(buffer);
+    ips.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        ips.append(routePrefixToString(routePrefixAt(buffer, i)));
+    }
+    return ips;
+}
+
+} // namespace amnezia
+
+#endif // ROUTEPREFIXES_H
@@ -21,6 +21,8 @@ Logger logger("WgDaemonServer");
 LocalServer::LocalServer(QObject *parent) : QObject(parent),
     m_ipcServer(this)
 {
+    m_ipcServer.setRemoteObjectHost(&m_serverNode);
+
     // Create the server and listen outside of QtRO
     m_server = QSharedPointer<QLocalServer>(new QLocalServer(this));
     m_server->setSocketOptions(QLocalServer::WorldAccessOption);
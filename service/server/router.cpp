@@ -1,5 +1,7 @@
 #include "router.h"
 
+#include "routeprefixes.h"
+
 #ifdef Q_OS_WIN
 #include "router_win.h"
 #elif defined (Q_OS_MAC)
@@ -9,14 +11,14 @@
 #endif
 
 
-int Router::routeAddList(const QString &gw, const QStringList &ips)
+int Router::routeAddList(const QString &gw, const QStringList &ips, QStringList *added)
 {
 #ifdef Q_OS_WIN
-    return RouterWin::Instance().routeAddList(gw, ips);
+    return RouterWin::Instance().routeAddList(gw, ips, added);
 #elif defined (Q_OS_MAC)
-    return RouterMac::Instance().routeAddList(gw, ips);
+    return RouterMac::Instance().routeAddList(gw, ips, added);
 #elif defined Q_OS_LINUX
-    return RouterLinux::Instance().routeAddList(gw, ips);
+    return RouterLinux::Instance().routeAddList(gw, ips, added);
 #endif
 }
 
@@ -31,14 +33,32 @@ bool Router::clearSavedRoutes()
 #endif
 }
 
-int Router::routeDeleteList(const QString &gw, const QStringList &ips)
+int Router::routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted)
 {
 #ifdef Q_OS_WIN
-    return RouterWin::Instance().routeDeleteList(gw, ips);
+    return RouterWin::Instance().routeDeleteList(gw, ips, deleted);
 #elif defined (Q_OS_MAC)
-    return RouterMac::Instance().routeDeleteList(gw, ips);
+    return RouterMac::Instance().routeDeleteList(gw, ips, deleted);
 #elif defined Q_OS_LINUX
-    return RouterLinux::Instance().routeDeleteList(gw, ips);
+    return RouterLinux::Instance().routeDeleteList(gw, ips, deleted);
+#endif
+}
+
+int Router::routeAddPrefixes(const QString &gw, const QByteArray &prefixes)
+{
+#ifdef Q_OS_LINUX
+    return RouterLinux::Instance().routeAddPrefixes(gw, prefixes);
+#else
+    return routeAddList(gw, amnezia::routePrefixesToStrings(prefixes));
+#endif
+}
+
+int Router::routeDeletePrefixes(const QString &gw, const QByteArray &prefixes)
+{
+#ifdef Q_OS_LINUX
+    return RouterLinux::Instance().routeDeletePrefixes(gw, prefixes);
+#else
+    return routeDeleteList(gw, amnezia::routePrefixesToStrings(prefixes));
 #endif
 }
 
@@ -99,6 +119,19 @@ bool Router::updateResolvers(const QString& ifname, const QList<QHostAddress>& r
 #endif
 }
 
+bool Router::restoreResolvers()
+{
+#ifdef Q_OS_LINUX
+    return RouterLinux::Instance().restoreResolvers();
+#endif
+#ifdef Q_OS_MACOS
+    return RouterMac::Instance().restoreResolvers();
+#endif
+#ifdef Q_OS_WIN
+    return RouterWin::Instance().restoreResolvers();
+#endif
+}
+
 
 void Router::StopRoutingIpv6()
 {
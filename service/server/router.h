@@ -16,9 +16,13 @@ class Router : public QObject
 {
     Q_OBJECT
 public:
-    static int routeAddList(const QString &gw, const QStringList &ips);
+    // added and deleted receive the routes that were actually changed, without the
+    // ones that already existed or were already gone
+    static int routeAddList(const QString &gw, const QStringList &ips, QStringList *added = nullptr);
     static bool clearSavedRoutes();
-    static int routeDeleteList(const QString &gw, const QStringList &ips);
+    static int routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted = nullptr);
+    static int routeAddPrefixes(const QString &gw, const QByteArray &prefixes);
+    static int routeDeletePrefixes(const QString &gw, const QByteArray &prefixes);
     static void flushDns();
     static void resetIpStack();
     static bool createTun(const QString &dev, const QString &subnet);
@@ -26,6 +30,7 @@ public:
     static void StartRoutingIpv6();
     static void StopRoutingIpv6();
     static bool updateResolvers(const QString& ifname, const QList<QHostAddress>& resolvers);
+    static bool restoreResolvers();
 };
 
 #endif // ROUTER_H
@@ -22,6 +22,8 @@
 
 #include <core/networkUtilities.h>
 
+#include "routeprefixes.h"
+
 RouterLinux &RouterLinux::Instance()
 {
     static RouterLinux s;
@@ -70,12 +72,15 @@ bool RouterLinux::routeAdd(const QString &ipWithSubnet, const QString &gw, const
     return true;
 }
 
-int RouterLinux::routeAddList(const QString &gw, const QStringList &ips)
+int RouterLinux::routeAddList(const QString &gw, const QStringList &ips, QStringList *added)
 {
     int temp_sock = socket(AF_INET, SOCK_DGRAM,  IPPROTO_IP);
     int cnt = 0;
     for (const QString &ip: ips) {
-        if (routeAdd(ip, gw, temp_sock)) cnt++;
+        if (routeAdd(ip, gw, temp_sock)) {
+            cnt++;
+            if (added) added->append(ip);
+        }
     }
     close(temp_sock);
     return cnt;
@@ -141,12 +146,82 @@ bool RouterLinux::routeDelete(const QString &ipWithSubnet, const QString &gw, co
     return true;
 }
 
-bool RouterLinux::routeDeleteList(const QString &gw, const QStringList &ips)
+bool RouterLinux::routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted)
 {
     int temp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
     int cnt = 0;
     for (const QString &ip: ips) {
-        if (routeDelete(ip, gw, temp_sock)) cnt++;
+        if (routeDelete(ip, gw, temp_sock)) {
+            cnt++;
+            // routeDelete() reports the default route as deleted but skips it
+            if (deleted && ip != "0.0.0.0/0") deleted->append(ip);
+        }
+    }
+    close(temp_sock);
+    return cnt;
+}
+
+int RouterLinux::routeAddPrefixes(const QString &gw, const QByteArray &prefixes)
+{
+    return routeChangePrefixes(SIOCADDRT, gw, prefixes);
+}
+
+int RouterLinux::routeDeletePrefixes(const QString &gw, const QByteArray &prefixes)
+{
+    return routeChangePrefixes(SIOCDELRT, gw, prefixes);
+}
+
+// Binary counterpart of routeAdd()/routeDelete(): the gateway is parsed once and
+// every prefix goes to the ioctl as is, without string conversions
+int RouterLinux::routeChangePrefixes(unsigned long request, const QString &gw, const QByteArray &prefixes)
+{
+    if (!NetworkUtilities::checkIPv4Format(gw)) {
+        qCritical().noquote() << "Critical, trying to change routes with invalid gateway: " << gw;
+        return 0;
+    }
+
+    const in_addr_t gwAddr = inet_addr(gw.toStdString().c_str());
+    const int count = amnezia::routePrefixCount(prefixes);
+
+    int temp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    int cnt = 0;
+    for (int i = 0; i < count; ++i) {
+        const amnezia::RoutePrefix prefix = amnezia::routePrefixAt(prefixes, i);
+        if (prefix.family != 4 || prefix.length > 32) {
+            continue;
+        }
+        if (request == SIOCDELRT && prefix.length == 0) {
+            qDebug().noquote() << "Warning, trying to remove default route, skipping: " << gw;
+            cnt++;
+            continue;
+        }
+
+        in_addr_t dst;
+        memcpy(&dst, prefix.address, sizeof(dst));
+        const in_addr_t mask = prefix.length ? htonl(0xFFFFFFFFu << (32 - prefix.length)) : 0;
+
+        struct rtentry route;
+        memset(&route, 0, sizeof( route ));
+
+        ((struct sockaddr_in *)&route.rt_gateway)->sin_family = AF_INET;
+        ((struct sockaddr_in *)&route.rt_gateway)->sin_addr.s_addr = gwAddr;
+        ((struct sockaddr_in *)&route.rt_dst)->sin_family = AF_INET;
+        ((struct sockaddr_in *)&route.rt_dst)->sin_addr.s_addr = dst;
+        ((struct sockaddr_in *)&route.rt_genmask)->sin_family = AF_INET;
+        ((struct sockaddr_in *)&route.rt_genmask)->sin_addr.s_addr = mask;
+
+        route.rt_flags = RTF_UP | RTF_GATEWAY;
+        route.rt_metric = 0;
+
+        if (ioctl(temp_sock, request, &route) < 0) {
+            qDebug().noquote() << "route change error: gw " << gw << " ip " << amnezia::routePrefixToString(prefix);
+            continue;
+        }
+
+        if (request == SIOCADDRT) {
+            m_addedRoutes.append({amnezia::routePrefixToString(prefix), gw});
+        }
+        cnt++;
     }
     close(temp_sock);
     return cnt;
@@ -271,6 +346,11 @@ bool RouterLinux::updateResolvers(const QString& ifname, const QList<QHostAddres
     return m_dnsUtil->updateResolvers(ifname, resolvers);
 }
 
+bool RouterLinux::restoreResolvers()
+{
+    return m_dnsUtil->restoreResolvers();
+}
+
 void RouterLinux::StartRoutingIpv6()
 {
     QProcess process;
@@ -25,10 +25,12 @@ public:
     static RouterLinux& Instance();
 
     bool routeAdd(const QString &ip, const QString &gw, const int &sock);
-    int routeAddList(const QString &gw, const QStringList &ips);
+    int routeAddList(const QString &gw, const QStringList &ips, QStringList *added = nullptr);
     bool clearSavedRoutes();
     bool routeDelete(const QString &ip, const QString &gw, const int &sock);
-    bool routeDeleteList(const QString &gw, const QStringList &ips);
+    bool routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted = nullptr);
+    int routeAddPrefixes(const QString &gw, const QByteArray &prefixes);
+    int routeDeletePrefixes(const QString &gw, const QByteArray &prefixes);
     QString getgatewayandiface();
     void flushDns();
     bool createTun(const QString &dev, const QString &subnet);
@@ -36,9 +38,12 @@ public:
     void StartRoutingIpv6();
     void StopRoutingIpv6();
     bool updateResolvers(const QString& ifname, const QList<QHostAddress>& resolvers);
+    bool restoreResolvers();
 public slots:
 
 private:
+    int routeChangePrefixes(unsigned long request, const QString &gw, const QByteArray &prefixes);
+
     RouterLinux() {m_dnsUtil = new DnsUtilsLinux(this);}
     RouterLinux(RouterLinux const &) = delete;
     RouterLinux& operator= (RouterLinux const&) = delete;
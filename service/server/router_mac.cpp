@@ -55,11 +55,15 @@ bool RouterMac::routeAdd(const QString &ipWithSubnet, const QString &gw)
     return true;
 }
 
-int RouterMac::routeAddList(const QString &gw, const QStringList &ips)
+// The route tool result is not checked, every valid route counts as added or deleted
+int RouterMac::routeAddList(const QString &gw, const QStringList &ips, QStringList *added)
 {
     int cnt = 0;
     for (const QString &ip: ips) {
-        if (routeAdd(ip, gw)) cnt++;
+        if (routeAdd(ip, gw)) {
+            cnt++;
+            if (added) added->append(ip);
+        }
     }
     return cnt;
 }
@@ -121,11 +125,15 @@ bool RouterMac::routeDelete(const QString &ipWithSubnet, const QString &gw)
     return true;
 }
 
-bool RouterMac::routeDeleteList(const QString &gw, const QStringList &ips)
+bool RouterMac::routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted)
 {
     int cnt = 0;
     for (const QString &ip: ips) {
-        if (routeDelete(ip, gw)) cnt++;
+        if (routeDelete(ip, gw)) {
+            cnt++;
+            // routeDelete() reports the default route as deleted but skips it
+            if (deleted && ip != "0.0.0.0/0") deleted->append(ip);
+        }
     }
     return cnt;
 }
@@ -158,6 +166,11 @@ bool RouterMac::updateResolvers(const QString& ifname, const QList<QHostAddress>
     return m_dnsUtil->updateResolvers(ifname, resolvers);
 }
 
+bool RouterMac::restoreResolvers()
+{
+    return m_dnsUtil->restoreResolvers();
+}
+
 
 bool RouterMac::deleteTun(const QString &dev)
 {
@@ -25,14 +25,15 @@ public:
     };
 
     bool routeAdd(const QString &ip, const QString &gw);
-    int routeAddList(const QString &gw, const QStringList &ips);
+    int routeAddList(const QString &gw, const QStringList &ips, QStringList *added = nullptr);
     bool clearSavedRoutes();
     bool routeDelete(const QString &ip, const QString &gw);
-    bool routeDeleteList(const QString &gw, const QStringList &ips);
+    bool routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted = nullptr);
     void flushDns();
     bool createTun(const QString &dev, const QString &subnet);
     bool deleteTun(const QString &dev);
     bool updateResolvers(const QString& ifname, const QList<QHostAddress>& resolvers);
+    bool restoreResolvers();
     
 public slots:
 
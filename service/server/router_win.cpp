@@ -26,7 +26,7 @@ RouterWin &RouterWin::Instance()
     return s;
 }
 
-int RouterWin::routeAddList(const QString &gw, const QStringList &ips)
+int RouterWin::routeAddList(const QString &gw, const QStringList &ips, QStringList *added)
 {
 //    qDebug().noquote() << QString("ROUTE ADD List: IPs size:%1, GW: %2")
 //                          .arg(ips.size())
@@ -124,6 +124,7 @@ int RouterWin::routeAddList(const QString &gw, const QStringList &ips)
         if (dwStatus == NO_ERROR){
             m_ipForwardRows.insert(ip, ipfrow);
             success_count++;
+            if (added) added->append(ipWithMask);
         }
         else if (dwStatus == ERROR_OBJECT_ALREADY_EXISTS) {
             m_ipForwardRows.insert(ip, ipfrow);
@@ -199,7 +200,7 @@ bool RouterWin::clearSavedRoutes()
     return true;
 }
 
-int RouterWin::routeDeleteList(const QString &gw, const QStringList &ips)
+int RouterWin::routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted)
 {
 //    qDebug().noquote() << QString("ROUTE DELETE List: IPs size:%1, GW: %2")
 //                          .arg(ips.size())
@@ -260,6 +261,7 @@ int RouterWin::routeDeleteList(const QString &gw, const QStringList &ips)
             if (dwStatus == ERROR_SUCCESS) {
                 m_ipForwardRows.remove(ipMap.value(ipfrow.dwForwardDest).first);
                 success_count++;
+                if (deleted) deleted->append(ipMap.value(ipfrow.dwForwardDest).first);
             }
         }
     }
@@ -443,6 +445,11 @@ bool RouterWin::updateResolvers(const QString& ifname, const QList<QHostAddress>
     return m_dnsUtil->updateResolvers(ifname, resolvers);
 }
 
+bool RouterWin::restoreResolvers()
+{
+    return m_dnsUtil->restoreResolvers();
+}
+
 
 void RouterWin::StopRoutingIpv6()
 {
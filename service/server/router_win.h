@@ -36,9 +36,9 @@ class RouterWin : public QObject
 public:
     static RouterWin& Instance();
 
-    int routeAddList(const QString &gw, const QStringList &ips);
+    int routeAddList(const QString &gw, const QStringList &ips, QStringList *added = nullptr);
     bool clearSavedRoutes();
-    int routeDeleteList(const QString &gw, const QStringList &ips);
+    int routeDeleteList(const QString &gw, const QStringList &ips, QStringList *deleted = nullptr);
     void flushDns();
     void resetIpStack();
 
@@ -47,6 +47,7 @@ public:
 
     void suspendWcmSvc(bool suspend);
     bool updateResolvers(const QString& ifname, const QList<QHostAddress>& resolvers);
+    bool restoreResolvers();
 
 private:
     RouterWin(RouterWin const &) = delete;